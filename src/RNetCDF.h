@@ -63,19 +63,39 @@ R_nc_close (SEXP ptr);
 SEXP
 R_nc_create (SEXP filename, SEXP clobber, SEXP share, SEXP prefill,
              SEXP format, SEXP diskless, SEXP persist,
-             SEXP mpi_comm, SEXP mpi_info);
+             SEXP mpi_comm, SEXP mpi_info, SEXP cache);
 
 SEXP
 R_nc_inq_file (SEXP nc);
 
+SEXP
+R_nc_inq_path (SEXP nc);
+
 SEXP
 R_nc_open (SEXP filename, SEXP write, SEXP share, SEXP prefill,
-           SEXP diskless, SEXP persist, SEXP mpi_comm, SEXP mpi_info);
+           SEXP diskless, SEXP persist, SEXP mpi_comm, SEXP mpi_info,
+           SEXP cache);
+
+SEXP
+R_nc_scan_file (SEXP path, SEXP atts, SEXP timevar);
 
 SEXP
 R_nc_sync (SEXP nc);
 
 
+/* Appenders */
+
+SEXP
+R_nc_def_append (SEXP nc, SEXP vars, SEXP batch, SEXP maxwait,
+                 SEXP namode, SEXP pack);
+
+SEXP
+R_nc_put_append (SEXP ptr, SEXP data);
+
+SEXP
+R_nc_sync_append (SEXP ptr);
+
+
 /* Dimensions */
 
 SEXP
@@ -87,6 +107,9 @@ R_nc_inq_dim (SEXP nc, SEXP dim);
 SEXP
 R_nc_inq_unlimids (SEXP nc);
 
+SEXP
+R_nc_range_dim (SEXP nc, SEXP dim, SEXP range);
+
 SEXP
 R_nc_rename_dim (SEXP nc, SEXP dim, SEXP newname);
 
@@ -120,10 +143,35 @@ R_nc_inq_varids (SEXP nc);
 SEXP
 R_nc_inq_dimids (SEXP nc, SEXP ancestors);
 
+SEXP
+R_nc_inq_grp_tree (SEXP nc, SEXP ancestors, SEXP recursive);
+
+SEXP
+R_nc_inq_meta (SEXP nc, SEXP fitnum);
+
 SEXP
 R_nc_rename_grp (SEXP nc, SEXP grpname);
 
 
+/* Reductions */
+
+SEXP
+R_nc_filter_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP op,
+                 SEXP value, SEXP namode, SEXP unpack);
+
+SEXP
+R_nc_hist_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP breaks,
+               SEXP right, SEXP namode, SEXP unpack);
+
+SEXP
+R_nc_quantile_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP probs,
+                   SEXP compression, SEXP namode, SEXP unpack);
+
+SEXP
+R_nc_reduce_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP factor,
+                 SEXP stat, SEXP narm, SEXP namode, SEXP unpack);
+
+
 /* Types */
 
 SEXP
@@ -165,6 +213,20 @@ R_nc_get_var (SEXP nc, SEXP var, SEXP start, SEXP count,
 SEXP
 R_nc_inq_var (SEXP nc, SEXP var);
 
+SEXP
+R_nc_inq_var_dimlen (SEXP nc, SEXP var);
+
+SEXP
+R_nc_inq_vars (SEXP nc, SEXP vars, SEXP storage);
+
+SEXP
+R_nc_iter_next (SEXP ptr);
+
+SEXP
+R_nc_iter_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP along,
+               SEXP prefetch, SEXP rawchar, SEXP fitnum, SEXP namode,
+               SEXP unpack);
+
 SEXP
 R_nc_par_var (SEXP nc, SEXP var, SEXP access);
 
@@ -173,6 +235,14 @@ R_nc_put_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP data,
               SEXP namode, SEXP pack,
               SEXP cache_bytes, SEXP cache_slots, SEXP cache_preemption);
 
+SEXP
+R_nc_put_vars (SEXP nc, SEXP vars, SEXP start, SEXP count, SEXP data,
+               SEXP namode, SEXP pack);
+
+SEXP
+R_nc_scatter_var (SEXP nc, SEXP var, SEXP index, SEXP data,
+                  SEXP namode, SEXP pack);
+
 SEXP
 R_nc_rename_var (SEXP nc, SEXP var, SEXP newname);
 
@@ -0,0 +1,523 @@
+/*=============================================================================*\
+ *
+ *  Name:       append.c
+ *
+ *  Version:    2.4-1
+ *
+ *  Purpose:    Buffered appending of records to NetCDF variables for RNetCDF
+ *
+ *  Author:     Pavel Michna (rnetcdf-devel@bluewin.ch)
+ *              Milton Woods (miltonjwoods@gmail.com)
+ *
+ *  Copyright:  (C) 2004-2020 Pavel Michna, Milton Woods
+ *
+ *=============================================================================*
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *=============================================================================*
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <netcdf.h>
+
+#include "common.h"
+#include "convert.h"
+#include "RNetCDF.h"
+
+
+/*=============================================================================*\
+ *  Appender state.
+\*=============================================================================*/
+
+/* Details of a variable written by an appender.
+   Members start and count are in C order, with the record dimension first;
+   count[0] is set to the number of records in each conversion or write.
+ */
+typedef struct {
+  int varid, ndims;
+  nc_type xtype;
+  size_t *start, *count;
+  size_t recbytes, fillsize;
+  void *fill;
+  double scale, add, *scalep, *addp;
+  char *buf;
+} R_nc_append_var;
+
+/* State of an appender, which holds up to batch records for each variable.
+   Buffered records are written starting at record rec of the dataset.
+   Appenders are kept in a list, so that buffered records can be written
+   when their dataset is synchronised or closed; ncid is set to -1 when the
+   dataset has been closed.
+ */
+typedef struct R_nc_append {
+  int ncid, nvars;
+  size_t rec, nbuf, batch;
+  double maxwait;
+  time_t first;
+  R_nc_append_var *vars;
+  struct R_nc_append *next;
+} R_nc_append;
+
+static R_nc_append *R_nc_append_list = NULL;
+
+
+/* Write n records for each variable of an appender from buffers in bufs.
+   Result is a netcdf status value.
+ */
+static int
+R_nc_append_write (R_nc_append *app, const void **bufs, size_t n)
+{
+  int ii, status;
+  R_nc_append_var *var;
+
+  if (n == 0) {
+    return NC_NOERR;
+  }
+  if (app->ncid < 0) {
+    return NC_EBADID;
+  }
+
+  status = R_nc_enddef (app->ncid);
+  for (ii=0; ii<app->nvars && status == NC_NOERR; ii++) {
+    var = &(app->vars[ii]);
+    var->start[0] = app->rec;
+    var->count[0] = n;
+    R_nc_coord_forget (app->ncid, var->varid);
+    status = nc_put_vara (app->ncid, var->varid,
+                          var->start, var->count, bufs[ii]);
+  }
+
+  /* Records of a failed write are written again at the same position
+     by a later attempt, keeping the record dimension consistent
+     across variables */
+  if (status == NC_NOERR) {
+    app->rec += n;
+  }
+  return status;
+}
+
+
+/* Write the records buffered by an appender.
+   Result is a netcdf status value.
+ */
+static int
+R_nc_append_flush (R_nc_append *app)
+{
+  int ii, status;
+  const void **bufs;
+
+  if (app->nbuf == 0) {
+    return NC_NOERR;
+  }
+
+  bufs = (const void **) R_Calloc (app->nvars, void *);
+  for (ii=0; ii<app->nvars; ii++) {
+    bufs[ii] = app->vars[ii].buf;
+  }
+  status = R_nc_append_write (app, bufs, app->nbuf);
+  R_Free (bufs);
+
+  /* Buffered records are kept if they cannot be written,
+     so that the write is attempted again by the next flush */
+  if (status == NC_NOERR) {
+    app->nbuf = 0;
+  }
+
+  return status;
+}
+
+
+/* Write the records buffered by an appender if the oldest of them
+   has waited at least maxwait seconds.
+   Result is a netcdf status value.
+ */
+static int
+R_nc_append_due (R_nc_append *app)
+{
+  if (app->nbuf > 0 && R_FINITE (app->maxwait) &&
+      difftime (time (NULL), app->first) >= app->maxwait) {
+    return R_nc_append_flush (app);
+  }
+  return NC_NOERR;
+}
+
+
+int
+R_nc_append_expire (int ncid)
+{
+  R_nc_append *app;
+  int status=NC_NOERR, flushstat;
+
+  for (app=R_nc_append_list; app; app=app->next) {
+    if (app->ncid >= 0 && RNC_DATASET_ID (app->ncid) == RNC_DATASET_ID (ncid)) {
+      flushstat = R_nc_append_due (app);
+      if (status == NC_NOERR) {
+        status = flushstat;
+      }
+    }
+  }
+  return status;
+}
+
+
+int
+R_nc_append_sync (int ncid, int detach)
+{
+  R_nc_append *app;
+  int status=NC_NOERR, flushstat;
+
+  for (app=R_nc_append_list; app; app=app->next) {
+    if (app->ncid >= 0 && RNC_DATASET_ID (app->ncid) == RNC_DATASET_ID (ncid)) {
+      flushstat = R_nc_append_flush (app);
+      if (status == NC_NOERR) {
+        status = flushstat;
+      }
+      if (detach) {
+        app->ncid = -1;
+      }
+    }
+  }
+  return status;
+}
+
+
+/* Release memory held by an appender, after writing any buffered records.
+   Errors cannot be raised from a finalizer, so a warning is issued
+   if the records cannot be written.
+ */
+static void
+R_nc_append_free (SEXP ptr)
+{
+  R_nc_append *app, **link;
+  int ii, status;
+
+  app = R_ExternalPtrAddr (ptr);
+  if (app) {
+    status = R_nc_append_flush (app);
+    if (status != NC_NOERR) {
+      warning ("Records of released NetCDF appender were not written: %s",
+               nc_strerror (status));
+    }
+
+    for (link=&R_nc_append_list; *link; link=&((*link)->next)) {
+      if (*link == app) {
+        *link = app->next;
+        break;
+      }
+    }
+
+    for (ii=0; ii<app->nvars; ii++) {
+      R_Free (app->vars[ii].start);
+      R_Free (app->vars[ii].count);
+      if (app->vars[ii].fill) {
+        R_Free (app->vars[ii].fill);
+      }
+      if (app->vars[ii].buf) {
+        R_Free (app->vars[ii].buf);
+      }
+    }
+    R_Free (app->vars);
+    R_Free (app);
+    R_ClearExternalPtr (ptr);
+  }
+}
+
+
+/* Find the appender referenced by an R external pointer */
+static R_nc_append *
+R_nc_append_ptr (SEXP ptr)
+{
+  R_nc_append *app;
+
+  if (TYPEOF (ptr) != EXTPTRSXP) {
+    error ("Not a valid NetCDF appender");
+  }
+  app = R_ExternalPtrAddr (ptr);
+  if (!app) {
+    error ("NetCDF appender has been released");
+  }
+  if (app->ncid < 0) {
+    error ("NetCDF dataset of appender has been closed");
+  }
+  return app;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_def_append()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_def_append (SEXP nc, SEXP vars, SEXP batch, SEXP maxwait,
+                 SEXP namode, SEXP pack)
+{
+  int ncid, nvars, ndims, ii, jj, *dimids, recdim=-1, nunlim, *unlimids;
+  int inamode, ispack, isunlim;
+  size_t dimlen, elsize, recbytes, totbytes, nbatch, fillsize;
+  double batch_in;
+  void *fillp, *minp, *maxp;
+  char varname[NC_MAX_NAME + 1];
+  nc_type xtype;
+  R_nc_append *app;
+  R_nc_append_var *var;
+  SEXP result;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  if (!isNewList (vars) || xlength (vars) < 1) {
+    error ("Appender requires a list of variables");
+  }
+  nvars = xlength (vars);
+
+  batch_in = asReal (batch);
+  if (!R_FINITE (batch_in) || batch_in < 1) {
+    error ("Batch size must be a positive number of records");
+  }
+
+  inamode = asInteger (namode);
+  ispack = (asLogical (pack) == TRUE);
+
+  R_nc_check (R_nc_unlimdims (ncid, &nunlim, &unlimids));
+
+  /*-- Initialise appender state, released by finalizer on error --------------*/
+  app = R_Calloc (1, R_nc_append);
+  app->ncid = ncid;
+  app->nvars = 0;
+  app->maxwait = asReal (maxwait);
+  app->vars = R_Calloc (nvars, R_nc_append_var);
+
+  result = PROTECT(R_MakeExternalPtr (app, R_NilValue, nc));
+  R_RegisterCFinalizerEx (result, &R_nc_append_free, TRUE);
+
+  /*-- Check that variables share an unlimited first dimension ----------------*/
+  totbytes = 0;
+  for (ii=0; ii<nvars; ii++) {
+    var = &(app->vars[ii]);
+    app->nvars = ii + 1;
+
+    R_nc_check (R_nc_var_id (VECTOR_ELT (vars, ii), ncid, &(var->varid)));
+    R_nc_check (nc_inq_var (ncid, var->varid, varname, &xtype, &ndims,
+                            NULL, NULL));
+    if (xtype == NC_CHAR || xtype == NC_STRING || xtype > NC_MAX_ATOMIC_TYPE) {
+      error ("Appender does not support type of variable %s", varname);
+    }
+    if (ndims < 1) {
+      error ("Variable %s has no record dimension", varname);
+    }
+
+    dimids = (int *) R_alloc (ndims, sizeof (int));
+    R_nc_check (nc_inq_vardimid (ncid, var->varid, dimids));
+    if (ii == 0) {
+      recdim = dimids[0];
+      isunlim = 0;
+      for (jj=0; jj<nunlim; jj++) {
+        isunlim = isunlim || (unlimids[jj] == recdim);
+      }
+      if (!isunlim) {
+        error ("Variable %s has no unlimited dimension in slowest varying position",
+               varname);
+      }
+    } else if (dimids[0] != recdim) {
+      error ("Variable %s has a different record dimension", varname);
+    }
+
+    var->xtype = xtype;
+    var->ndims = ndims;
+    var->start = R_Calloc (ndims, size_t);
+    var->count = R_Calloc (ndims, size_t);
+    var->count[0] = 1;
+    R_nc_check (nc_inq_type (ncid, xtype, NULL, &elsize));
+    recbytes = elsize;
+    for (jj=1; jj<ndims; jj++) {
+      R_nc_check (nc_inq_dimlen (ncid, dimids[jj], &dimlen));
+      var->count[jj] = dimlen;
+      recbytes *= dimlen;
+    }
+    var->recbytes = recbytes;
+    totbytes += recbytes;
+
+    /* Attributes are read once, rather than for every record */
+    fillsize = R_nc_miss_att (ncid, var->varid, inamode, &fillp, &minp, &maxp);
+    if (fillsize > 0) {
+      var->fill = R_Calloc (fillsize, char);
+      memcpy (var->fill, fillp, fillsize);
+      var->fillsize = fillsize;
+    }
+
+    if (ispack) {
+      var->scalep = &(var->scale);
+      var->addp = &(var->add);
+      R_nc_pack_att (ncid, var->varid, &(var->scalep), &(var->addp));
+    }
+  }
+
+  /*-- Allocate buffers for a batch of records --------------------------------*/
+  nbatch = batch_in;
+  if (totbytes > 0 && nbatch > RNC_MAXBYTES / totbytes) {
+    nbatch = RNC_MAXBYTES / totbytes;
+  }
+  if (nbatch < 1) {
+    nbatch = 1;
+  }
+  app->batch = nbatch;
+
+  for (ii=0; ii<nvars; ii++) {
+    var = &(app->vars[ii]);
+    if (var->recbytes > 0) {
+      var->buf = R_Calloc (nbatch * var->recbytes, char);
+    }
+  }
+
+  /*-- Append after existing records ------------------------------------------*/
+  R_nc_check (nc_inq_dimlen (ncid, recdim, &dimlen));
+  app->rec = dimlen;
+
+  app->next = R_nc_append_list;
+  R_nc_append_list = app;
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_put_append()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_put_append (SEXP ptr, SEXP data)
+{
+  R_nc_append *app;
+  R_nc_append_var *var;
+  int ii, found;
+  size_t nrec, reclen, nn, done;
+  const void **bufs;
+  const char *src;
+
+  app = R_nc_append_ptr (ptr);
+
+  if (!isNewList (data) || xlength (data) != app->nvars) {
+    error ("Data must be a list with an element for each variable");
+  }
+
+  /*-- Find the number of records in the data ---------------------------------*/
+  nrec = 0;
+  found = 0;
+  for (ii=0; ii<app->nvars; ii++) {
+    var = &(app->vars[ii]);
+    var->count[0] = 1;
+    reclen = R_nc_length (var->ndims, var->count);
+    if (reclen == 0) {
+      continue;
+    }
+    if (xlength (VECTOR_ELT (data, ii)) % reclen != 0) {
+      error ("Data for variable %d is not a whole number of records", ii+1);
+    }
+    nn = xlength (VECTOR_ELT (data, ii)) / reclen;
+    if (!found) {
+      nrec = nn;
+      found = 1;
+    } else if (nn != nrec) {
+      error ("Data must contain the same number of records for all variables");
+    }
+  }
+
+  /*-- Convert all variables before changing the buffers ----------------------*/
+  bufs = (const void **) R_alloc (app->nvars, sizeof (void *));
+  for (ii=0; ii<app->nvars; ii++) {
+    var = &(app->vars[ii]);
+    var->count[0] = nrec;
+    bufs[ii] = NULL;
+    if (nrec > 0 && var->recbytes > 0) {
+      bufs[ii] = R_nc_r2c (VECTOR_ELT (data, ii), app->ncid, var->xtype,
+                           var->ndims, var->count, var->fillsize, var->fill,
+                           var->scalep, var->addp);
+    }
+  }
+
+  /*-- Buffer the records, writing each full batch ----------------------------*/
+  done = 0;
+  while (done < nrec) {
+    if (app->nbuf == 0 && nrec - done >= app->batch) {
+      /* Write whole batches directly from the converted data */
+      for (ii=0; ii<app->nvars; ii++) {
+        if (bufs[ii]) {
+          bufs[ii] = (const char *) bufs[ii] + done * app->vars[ii].recbytes;
+        }
+      }
+      R_nc_check (R_nc_append_write (app, bufs, nrec - done));
+      done = nrec;
+      break;
+    }
+
+    if (app->nbuf == 0) {
+      app->first = time (NULL);
+    }
+    nn = app->batch - app->nbuf;
+    if (nn > nrec - done) {
+      nn = nrec - done;
+    }
+    for (ii=0; ii<app->nvars; ii++) {
+      var = &(app->vars[ii]);
+      if (var->buf) {
+        src = (const char *) bufs[ii] + done * var->recbytes;
+        memcpy (var->buf + app->nbuf * var->recbytes, src, nn * var->recbytes);
+      }
+    }
+    app->nbuf += nn;
+    done += nn;
+
+    if (app->nbuf >= app->batch) {
+      R_nc_check (R_nc_append_flush (app));
+    }
+  }
+
+  /*-- Write records that have waited too long --------------------------------*/
+  R_nc_check (R_nc_append_expire (app->ncid));
+
+  /* Return the number of records written or buffered */
+  return ScalarReal (app->rec + app->nbuf);
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_sync_append()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_sync_append (SEXP ptr)
+{
+  R_nc_append *app;
+
+  app = R_nc_append_ptr (ptr);
+
+  /* Other appenders of the dataset are written if they have waited too long */
+  R_nc_check (R_nc_append_flush (app));
+  R_nc_check (R_nc_append_expire (app->ncid));
+
+  return ScalarReal (app->rec);
+}
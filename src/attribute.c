@@ -144,7 +144,7 @@ R_nc_delete_att (SEXP nc, SEXP var, SEXP att)
 SEXP
 R_nc_get_att (SEXP nc, SEXP var, SEXP att, SEXP rawchar, SEXP fitnum)
 {
-  int ncid, varid, israw, isfit;
+  int ncid, varid, attid, israw, isfit;
   char attname[NC_MAX_NAME+1];
   size_t cnt;
   nc_type xtype;
@@ -155,6 +155,9 @@ R_nc_get_att (SEXP nc, SEXP var, SEXP att, SEXP rawchar, SEXP fitnum)
   /*-- Convert arguments ------------------------------------------------------*/
   ncid = asInteger (nc);
 
+  israw = (asLogical (rawchar) == TRUE);
+  isfit = (asLogical (fitnum) == TRUE);
+
   if (R_nc_strcmp(var, "NC_GLOBAL")) {
     varid = NC_GLOBAL;
   } else {
@@ -163,8 +166,13 @@ R_nc_get_att (SEXP nc, SEXP var, SEXP att, SEXP rawchar, SEXP fitnum)
 
   R_nc_check (R_nc_att_name (att, ncid, varid, attname));
 
-  israw = (asLogical (rawchar) == TRUE);
-  isfit = (asLogical (fitnum) == TRUE);
+  /*-- Use cached value (if any) ----------------------------------------------*/
+  /* Values are cached separately for each mode of conversion */
+  R_nc_check (nc_inq_attid (ncid, varid, attname, &attid));
+  result = R_nc_cache_get (ncid, 'A', varid, 4*attid + 2*isfit + israw);
+  if (result) {
+    return result;
+  }
 
   /*-- Get the attribute's type and size --------------------------------------*/
   R_nc_check(nc_inq_att (ncid, varid, attname, &xtype, &cnt));
@@ -181,6 +189,8 @@ R_nc_get_att (SEXP nc, SEXP var, SEXP att, SEXP rawchar, SEXP fitnum)
   }
   R_nc_c2r (&io);
 
+  R_nc_cache_put (ncid, 'A', varid, 4*attid + 2*isfit + israw, result);
+
   UNPROTECT(1);
   return result;
 }
@@ -210,9 +220,15 @@ R_nc_inq_att (SEXP nc, SEXP var, SEXP att)
 
   R_nc_check (R_nc_att_name (att, ncid, varid, attname));
 
-  /*-- Inquire about the attribute --------------------------------------------*/
   R_nc_check (nc_inq_attid (ncid, varid, attname, &attid));
 
+  /*-- Use cached result (if any) ---------------------------------------------*/
+  result = R_nc_cache_get (ncid, 'a', varid, attid);
+  if (result) {
+    return result;
+  }
+
+  /*-- Inquire about the attribute --------------------------------------------*/
   R_nc_check (nc_inq_att (ncid, varid, attname, &type, &cnt));
 
   /*-- Convert nc_type to char ------------------------------------------------*/
@@ -226,6 +242,8 @@ R_nc_inq_att (SEXP nc, SEXP var, SEXP att)
   /* cnt may not fit in integer, so return as double */
   SET_VECTOR_ELT (result, 3, ScalarReal (cnt));
 
+  R_nc_cache_put (ncid, 'a', varid, attid, result);
+
   UNPROTECT(1);
   return result;
 }
@@ -89,7 +89,7 @@ R_nc_dim_id (SEXP dim, int ncid, int *dimid, int idx)
     *dimid = REAL (dim)[idx];
     return NC_NOERR;
   } else if (isString (dim)) {
-    return nc_inq_dimid (ncid, CHAR (STRING_ELT (dim, idx)), dimid);
+    return R_nc_name_id (ncid, 'd', CHAR (STRING_ELT (dim, idx)), dimid);
   } else {
     return NC_EINVAL;
   }
@@ -105,7 +105,7 @@ R_nc_var_id (SEXP var, int ncid, int *varid)
     *varid = asInteger (var);
     return NC_NOERR;
   } else if (isString (var)) {
-    return nc_inq_varid (ncid, CHAR (STRING_ELT (var, 0)), varid);
+    return R_nc_name_id (ncid, 'v', CHAR (STRING_ELT (var, 0)), varid);
   } else {
     return NC_EINVAL;
   }
@@ -274,7 +274,7 @@ R_nc_str2type (int ncid, const char *str, nc_type * xtype)
 
   if (*xtype == NC_NAT) {
     /* Try to get id of a user defined type */
-    return nc_inq_typeid (ncid, str, xtype);
+    return R_nc_name_id (ncid, 't', str, xtype);
   } else {
     return NC_NOERR;
   }
@@ -355,6 +355,13 @@ R_nc_redef (int ncid)
   if (status == NC_EINDEFINE) {
     status = NC_NOERR;
   }
+  if (status == NC_NOERR) {
+    /* Cached metadata may be changed in define mode,
+       including attributes used to unpack coordinate values */
+    R_nc_cache_forget (ncid);
+    R_nc_name_forget (ncid);
+    R_nc_coord_forget (ncid, -1);
+  }
   return status;
 }
 
@@ -366,3 +373,520 @@ R_nc_enddef (int ncid)
   return NC_NOERR;
 }
 
+
+int
+R_nc_unlimdims (int ncid, int *nunlim, int **unlimids)
+{
+  int status, format;
+
+  *nunlim = 0;
+
+  status = nc_inq_format (ncid, &format);
+  if (status != NC_NOERR) {
+    return status;
+  }
+
+  if (format == NC_FORMAT_NETCDF4) {
+    status = nc_inq_unlimdims (ncid, nunlim, NULL);
+    if (status != NC_NOERR) {
+      return status;
+    }
+
+    *unlimids = (void *) (R_alloc (*nunlim, sizeof (int)));
+
+    status = nc_inq_unlimdims (ncid, NULL, *unlimids);
+
+  } else {
+    *unlimids = (void *) (R_alloc (1, sizeof (int)));
+    status = nc_inq_unlimdim (ncid, *unlimids);
+    if (status == NC_NOERR && **unlimids != -1) {
+      *nunlim = 1;
+    }
+  }
+
+  return status;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  Metadata cache
+\*-----------------------------------------------------------------------------*/
+
+/* Datasets opened with a metadata cache. Items are found from their keys
+   in a hash table in C, and the cached values are kept in a generic vector,
+   which is the tag of the handle_ptr external pointer, so that they are
+   protected from garbage collection while the dataset is open.
+ */
+typedef struct R_nc_cache_item {
+  int grpid, kind, id, sub;
+  R_xlen_t pos;
+  struct R_nc_cache_item *next;
+} R_nc_cache_item;
+
+typedef struct R_nc_cache_entry {
+  int dsid;
+  size_t nkeys, nbucket;
+  R_nc_cache_item **buckets;
+  SEXP ptr;
+  struct R_nc_cache_entry *next;
+} R_nc_cache_entry;
+
+static R_nc_cache_entry *R_nc_cache_list = NULL;
+
+#define RNC_CACHE_MINBUCKET 64
+
+
+static R_nc_cache_entry *
+R_nc_cache_find (int ncid)
+{
+  R_nc_cache_entry *entry;
+  for (entry=R_nc_cache_list; entry; entry=entry->next) {
+    if (entry->dsid == RNC_DATASET_ID (ncid)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+static size_t
+R_nc_cache_hash (int grpid, int kind, int id, int sub)
+{
+  size_t hash;
+  hash = (unsigned int) grpid;
+  hash = hash * 31 + (unsigned int) kind;
+  hash = hash * 31 + (unsigned int) id;
+  hash = hash * 31 + (unsigned int) sub;
+  return hash;
+}
+
+
+/* Find an item of the cache, or return NULL if not found */
+static R_nc_cache_item *
+R_nc_cache_item_find (R_nc_cache_entry *entry, int grpid, int kind,
+                      int id, int sub)
+{
+  R_nc_cache_item *item;
+  size_t ib;
+
+  if (entry->nkeys == 0) {
+    return NULL;
+  }
+  ib = R_nc_cache_hash (grpid, kind, id, sub) & (entry->nbucket - 1);
+  for (item=entry->buckets[ib]; item; item=item->next) {
+    if (item->grpid == grpid && item->kind == kind &&
+        item->id == id && item->sub == sub) {
+      return item;
+    }
+  }
+  return NULL;
+}
+
+
+/* Double the number of buckets of a cache, moving the existing items */
+static void
+R_nc_cache_rehash (R_nc_cache_entry *entry)
+{
+  R_nc_cache_item **buckets, *item, *next;
+  size_t nbucket, ii, ib;
+
+  nbucket = 2 * entry->nbucket;
+  buckets = R_Calloc (nbucket, R_nc_cache_item *);
+  for (ii=0; ii<entry->nbucket; ii++) {
+    for (item=entry->buckets[ii]; item; item=next) {
+      next = item->next;
+      ib = R_nc_cache_hash (item->grpid, item->kind, item->id, item->sub) &
+             (nbucket - 1);
+      item->next = buckets[ib];
+      buckets[ib] = item;
+    }
+  }
+  R_Free (entry->buckets);
+  entry->buckets = buckets;
+  entry->nbucket = nbucket;
+}
+
+
+void
+R_nc_cache_init (SEXP ptr, int ncid)
+{
+  R_nc_cache_entry *entry;
+
+  entry = R_Calloc (1, R_nc_cache_entry);
+  entry->dsid = RNC_DATASET_ID (ncid);
+  entry->nkeys = 0;
+  entry->nbucket = RNC_CACHE_MINBUCKET;
+  entry->buckets = R_Calloc (entry->nbucket, R_nc_cache_item *);
+  entry->ptr = ptr;
+  entry->next = R_nc_cache_list;
+  R_nc_cache_list = entry;
+
+  R_SetExternalPtrTag (ptr, R_NilValue);
+}
+
+
+SEXP
+R_nc_cache_get (int ncid, int kind, int id, int sub)
+{
+  R_nc_cache_entry *entry;
+  R_nc_cache_item *item;
+
+  entry = R_nc_cache_find (ncid);
+  if (!entry) {
+    return NULL;
+  }
+
+  item = R_nc_cache_item_find (entry, RNC_GROUP_ID (ncid), kind, id, sub);
+  if (!item) {
+    return NULL;
+  }
+
+  /* Return a copy that the caller may modify */
+  return duplicate (VECTOR_ELT (R_ExternalPtrTag (entry->ptr), item->pos));
+}
+
+
+void
+R_nc_cache_put (int ncid, int kind, int id, int sub, SEXP value)
+{
+  R_nc_cache_entry *entry;
+  R_nc_cache_item *item;
+  SEXP values, grown;
+  R_xlen_t nvalue, ii;
+  size_t ib;
+  int grpid;
+
+  entry = R_nc_cache_find (ncid);
+  if (!entry) {
+    return;
+  }
+
+  PROTECT(value);
+  grpid = RNC_GROUP_ID (ncid);
+  item = R_nc_cache_item_find (entry, grpid, kind, id, sub);
+  if (!item) {
+    /*-- Enlarge the vector of values if it is full ---------------------------*/
+    values = R_ExternalPtrTag (entry->ptr);
+    nvalue = isNull (values) ? 0 : xlength (values);
+    if ((R_xlen_t) entry->nkeys >= nvalue) {
+      grown = PROTECT(allocVector (VECSXP, nvalue > 0 ? 2 * nvalue :
+                                                        RNC_CACHE_MINBUCKET));
+      for (ii=0; ii<nvalue; ii++) {
+        SET_VECTOR_ELT (grown, ii, VECTOR_ELT (values, ii));
+      }
+      R_SetExternalPtrTag (entry->ptr, grown);
+      UNPROTECT(1);
+    }
+
+    /*-- Insert a new item in the hash table ----------------------------------*/
+    if (entry->nkeys >= 2 * entry->nbucket) {
+      R_nc_cache_rehash (entry);
+    }
+    item = R_Calloc (1, R_nc_cache_item);
+    item->grpid = grpid;
+    item->kind = kind;
+    item->id = id;
+    item->sub = sub;
+    item->pos = entry->nkeys;
+    ib = R_nc_cache_hash (grpid, kind, id, sub) & (entry->nbucket - 1);
+    item->next = entry->buckets[ib];
+    entry->buckets[ib] = item;
+    entry->nkeys++;
+  }
+  SET_VECTOR_ELT (R_ExternalPtrTag (entry->ptr), item->pos, duplicate (value));
+  UNPROTECT(1);
+}
+
+
+/* Discard all items of a cache, keeping the cache enabled */
+static void
+R_nc_cache_clear (R_nc_cache_entry *entry)
+{
+  R_nc_cache_item *item, *next;
+  size_t ii;
+
+  for (ii=0; ii<entry->nbucket; ii++) {
+    for (item=entry->buckets[ii]; item; item=next) {
+      next = item->next;
+      R_Free (item);
+    }
+    entry->buckets[ii] = NULL;
+  }
+  entry->nkeys = 0;
+  R_SetExternalPtrTag (entry->ptr, R_NilValue);
+}
+
+
+void
+R_nc_cache_forget (int ncid)
+{
+  R_nc_cache_entry *entry;
+
+  entry = R_nc_cache_find (ncid);
+  if (entry && entry->nkeys > 0) {
+    R_nc_cache_clear (entry);
+  }
+}
+
+
+void
+R_nc_cache_free (int ncid)
+{
+  R_nc_cache_entry *entry, **prev;
+
+  for (prev=&R_nc_cache_list; *prev; prev=&((*prev)->next)) {
+    entry = *prev;
+    if (entry->dsid == RNC_DATASET_ID (ncid)) {
+      *prev = entry->next;
+      R_nc_cache_clear (entry);
+      R_Free (entry->buckets);
+      R_Free (entry);
+      return;
+    }
+  }
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  Name index
+\*-----------------------------------------------------------------------------*/
+
+/* Hash tables of the names of dimensions, variables or types defined in a
+   group, so that repeated lookups by name do not search all names in the
+   netcdf library. A table is built after a few lookups in a group, and it is
+   discarded whenever the dataset enters define mode (where items may be
+   defined or renamed). Names that are not in a table (e.g. dimensions of
+   ancestor groups) are passed to the netcdf library, as are all names of
+   a group for which the table could not be built.
+   Lookups before a table is built are counted in a small array indexed by
+   a hash of group and kind, where a slot is taken over by the latest group.
+ */
+#define RNC_NAME_MINLOOKUP 4
+#define RNC_NAME_NCOUNT 64
+
+static struct {
+  int ncid, kind, nlookup;
+} R_nc_name_count[RNC_NAME_NCOUNT];
+
+typedef struct R_nc_name_item {
+  char *name;
+  int id;
+  struct R_nc_name_item *next;
+} R_nc_name_item;
+
+typedef struct R_nc_name_table {
+  int ncid, kind, failed;
+  size_t nitem, nbucket;
+  R_nc_name_item *items, **buckets;
+  struct R_nc_name_table *next;
+} R_nc_name_table;
+
+static R_nc_name_table *R_nc_name_list = NULL;
+
+
+static size_t
+R_nc_name_hash (const char *name)
+{
+  size_t hash = 5381;
+  for (; *name; name++) {
+    hash = hash * 33 + (unsigned char) *name;
+  }
+  return hash;
+}
+
+
+/* Find the id of a name using the netcdf library */
+static int
+R_nc_name_lib (int ncid, int kind, const char *name, int *id)
+{
+  switch (kind) {
+  case 'd':
+    return nc_inq_dimid (ncid, name, id);
+  case 'v':
+    return nc_inq_varid (ncid, name, id);
+  case 't':
+    return nc_inq_typeid (ncid, name, id);
+  default:
+    return NC_EINVAL;
+  }
+}
+
+
+static void
+R_nc_name_clear (R_nc_name_table *table)
+{
+  size_t ii;
+  for (ii=0; ii<table->nitem; ii++) {
+    R_Free (table->items[ii].name);
+  }
+  if (table->items) {
+    R_Free (table->items);
+  }
+  if (table->buckets) {
+    R_Free (table->buckets);
+  }
+  table->nitem = 0;
+  table->nbucket = 0;
+}
+
+
+/* Fill a hash table with the names of all items of its kind in the group.
+   Result is a netcdf status value; the table is left empty if an error occurs.
+ */
+static int
+R_nc_name_build (R_nc_name_table *table)
+{
+  int status, nids, ii, *ids;
+  char name[NC_MAX_NAME+1];
+  R_nc_name_item *item;
+  size_t ib;
+
+  /*-- Find the ids of all items in the group ---------------------------------*/
+  switch (table->kind) {
+  case 'd':
+    status = nc_inq_dimids (table->ncid, &nids, NULL, 0);
+    break;
+  case 'v':
+    status = nc_inq_varids (table->ncid, &nids, NULL);
+    break;
+  case 't':
+    status = nc_inq_typeids (table->ncid, &nids, NULL);
+    break;
+  default:
+    status = NC_EINVAL;
+  }
+  if (status != NC_NOERR) {
+    return status;
+  }
+
+  ids = (int *) R_alloc (nids > 0 ? nids : 1, sizeof (int));
+  switch (table->kind) {
+  case 'd':
+    status = nc_inq_dimids (table->ncid, NULL, ids, 0);
+    break;
+  case 'v':
+    status = nc_inq_varids (table->ncid, NULL, ids);
+    break;
+  case 't':
+    status = nc_inq_typeids (table->ncid, NULL, ids);
+    break;
+  }
+  if (status != NC_NOERR) {
+    return status;
+  }
+
+  /*-- Insert the name of each item in a bucket -------------------------------*/
+  for (table->nbucket=8; table->nbucket<(size_t) nids; table->nbucket*=2);
+  table->buckets = R_Calloc (table->nbucket, R_nc_name_item *);
+  table->items = R_Calloc (nids > 0 ? nids : 1, R_nc_name_item);
+
+  for (ii=0; ii<nids; ii++) {
+    switch (table->kind) {
+    case 'd':
+      status = nc_inq_dimname (table->ncid, ids[ii], name);
+      break;
+    case 'v':
+      status = nc_inq_varname (table->ncid, ids[ii], name);
+      break;
+    case 't':
+      status = nc_inq_type (table->ncid, ids[ii], name, NULL);
+      break;
+    }
+    if (status != NC_NOERR) {
+      R_nc_name_clear (table);
+      return status;
+    }
+    item = &(table->items[ii]);
+    item->name = R_Calloc (strlen (name) + 1, char);
+    strcpy (item->name, name);
+    item->id = ids[ii];
+    ib = R_nc_name_hash (name) & (table->nbucket - 1);
+    item->next = table->buckets[ib];
+    table->buckets[ib] = item;
+    table->nitem++;
+  }
+
+  return NC_NOERR;
+}
+
+
+int
+R_nc_name_id (int ncid, int kind, const char *name, int *id)
+{
+  R_nc_name_table *table;
+  R_nc_name_item *item;
+  size_t ib, ic;
+
+  for (table=R_nc_name_list; table; table=table->next) {
+    if (table->ncid == ncid && table->kind == kind) {
+      break;
+    }
+  }
+
+  if (!table) {
+    /* Avoid building tables for groups that are rarely searched,
+       such as datasets that are alternately defined and written by name.
+     */
+    ic = ((unsigned int) ncid * 31 + kind) % RNC_NAME_NCOUNT;
+    if (R_nc_name_count[ic].ncid != ncid ||
+        R_nc_name_count[ic].kind != kind) {
+      R_nc_name_count[ic].ncid = ncid;
+      R_nc_name_count[ic].kind = kind;
+      R_nc_name_count[ic].nlookup = 0;
+    }
+    R_nc_name_count[ic].nlookup++;
+    if (R_nc_name_count[ic].nlookup < RNC_NAME_MINLOOKUP) {
+      return R_nc_name_lib (ncid, kind, name, id);
+    }
+    R_nc_name_count[ic].nlookup = 0;
+
+    table = R_Calloc (1, R_nc_name_table);
+    table->ncid = ncid;
+    table->kind = kind;
+    table->next = R_nc_name_list;
+    R_nc_name_list = table;
+
+    /* Later lookups in the group use the library if the build fails */
+    table->failed = (R_nc_name_build (table) != NC_NOERR);
+  }
+
+  if (table->failed) {
+    return R_nc_name_lib (ncid, kind, name, id);
+  }
+
+  ib = R_nc_name_hash (name) & (table->nbucket - 1);
+  for (item=table->buckets[ib]; item; item=item->next) {
+    if (strcmp (item->name, name) == 0) {
+      *id = item->id;
+      return NC_NOERR;
+    }
+  }
+  return R_nc_name_lib (ncid, kind, name, id);
+}
+
+
+void
+R_nc_name_forget (int ncid)
+{
+  R_nc_name_table *table, **prev;
+  int ic;
+
+  for (ic=0; ic<RNC_NAME_NCOUNT; ic++) {
+    if (R_nc_name_count[ic].nlookup > 0 &&
+        RNC_DATASET_ID (R_nc_name_count[ic].ncid) == RNC_DATASET_ID (ncid)) {
+      R_nc_name_count[ic].nlookup = 0;
+    }
+  }
+
+  prev = &R_nc_name_list;
+  while (*prev) {
+    table = *prev;
+    if (RNC_DATASET_ID (table->ncid) == RNC_DATASET_ID (ncid)) {
+      *prev = table->next;
+      R_nc_name_clear (table);
+      R_Free (table);
+    } else {
+      prev = &(table->next);
+    }
+  }
+}
@@ -42,6 +42,11 @@
 
 #define NA_SIZE SIZE_MAX
 
+/* Upper limit (bytes) of memory used by RNetCDF for buffers and caches,
+   including chunk caches enlarged automatically, records buffered by
+   an appender and slices read ahead by an iterator */
+#define RNC_MAXBYTES ((size_t) 256 * 1024 * 1024)
+
 /* Definition of missing value used by bit64 package */
 #define NA_INTEGER64 LLONG_MIN
 
@@ -127,4 +132,84 @@ int
 R_nc_enddef (int ncid);
 
 
+/* Find unlimited dimensions of a file or group.
+   Returns netcdf status. If no error occurs, nunlim and unlimids are set,
+   with memory for unlimids allocated by R_alloc.
+   Note - some netcdf4 versions only return unlimited dimensions defined in a group,
+     not those defined in the group and its ancestors as claimed in documentation.
+ */
+int
+R_nc_unlimdims (int ncid, int *nunlim, int **unlimids);
+
+
+/* Datasets are identified by the high bits of ncid, groups by the low bits */
+#define RNC_DATASET_ID(ncid) ((ncid) >> 16)
+#define RNC_GROUP_ID(ncid) ((ncid) & 0xFFFF)
+
+
+/* Discard values of coordinate variables kept in memory by R_nc_range_dim,
+   either for a given variable or (if varid < 0) for all variables in the
+   dataset containing ncid.
+ */
+void
+R_nc_coord_forget (int ncid, int varid);
+
+
+/* Write records buffered by appenders of the dataset containing ncid.
+   If detach is true, the appenders can no longer be used (dataset is closing).
+   Result is a netcdf status value.
+ */
+int
+R_nc_append_sync (int ncid, int detach);
+
+
+/* Write records buffered by appenders of the dataset containing ncid
+   that have waited at least maxwait seconds. This is called when the
+   dataset is read or synchronised, as there is no timer to expire records.
+   Result is a netcdf status value.
+ */
+int
+R_nc_append_expire (int ncid);
+
+
+/* Optional cache of metadata for a dataset, enabled by R_nc_cache_init
+   for the handle_ptr of a dataset after it is opened or created.
+   Items are identified by the group of ncid, a kind code ('d' dimension,
+   'v' variable, 'a' attribute, 'A' attribute value, 't' type, 'f' type
+   with fields), the id of the item and a second id (e.g. attribute number)
+   or 0 if unused. Callers resolve names to ids before using the cache.
+   R_nc_cache_get returns a copy of a cached item, or NULL if not found.
+   R_nc_cache_forget discards all items of the dataset containing ncid,
+   and it is called whenever the dataset enters define mode.
+   R_nc_cache_free disables the cache before a dataset is closed.
+ */
+void
+R_nc_cache_init (SEXP ptr, int ncid);
+
+SEXP
+R_nc_cache_get (int ncid, int kind, int id, int sub);
+
+void
+R_nc_cache_put (int ncid, int kind, int id, int sub, SEXP value);
+
+void
+R_nc_cache_forget (int ncid);
+
+void
+R_nc_cache_free (int ncid);
+
+
+/* Find the id of a dimension ('d'), variable ('v') or user-defined type ('t')
+   from its name in a group, using a hash table of names in the group.
+   R_nc_name_forget discards the tables of the dataset containing ncid,
+   and it is called whenever the dataset enters define mode or is closed.
+   Result of R_nc_name_id is a netcdf status value.
+ */
+int
+R_nc_name_id (int ncid, int kind, const char *name, int *id);
+
+void
+R_nc_name_forget (int ncid);
+
+
 #endif /* RNC_COMMON_H_INCLUDED */
@@ -1885,3 +1885,287 @@ R_NC_DIM_R2C (R_nc_dim_r2c_int, int, int)
 R_NC_DIM_R2C (R_nc_dim_r2c_size, size, size_t)
 
 
+/*=============================================================================*\
+ *  Missing value and packing attributes.
+\*=============================================================================*/
+
+/* Macros to set **max or **min so that **fill is outside valid range */
+#define FILL2RANGE_REAL(TYPE, EPS) { \
+  if (!ISNAN(**(TYPE **) fill)) { \
+    if (**(TYPE **) fill > (TYPE) 0) { \
+      *max = R_alloc (1, sizeof(TYPE)); \
+      **(TYPE **) max = **(TYPE **) fill * ((TYPE) 1 - (TYPE) 2 * (TYPE) EPS); \
+    } else { \
+      *min = R_alloc (1, sizeof(TYPE)); \
+      **(TYPE **) min = **(TYPE **) fill * ((TYPE) 1 + (TYPE) 2 * (TYPE) EPS); \
+    } \
+  } \
+}
+#define FILL2RANGE_INT(TYPE) { \
+  if (**(TYPE **) fill > (TYPE) 0) { \
+    *max = R_alloc (1, sizeof(TYPE)); \
+    **(TYPE **) max = **(TYPE **) fill - (TYPE) 1; \
+  } else { \
+    *min = R_alloc (1, sizeof(TYPE)); \
+    **(TYPE **) min = **(TYPE **) fill + (TYPE) 1; \
+  }; \
+}
+
+size_t
+R_nc_miss_att (int ncid, int varid, int mode,
+               void **fill, void **min, void **max)
+{
+  size_t cnt, size;
+  nc_type atype, xtype;
+  char *range;
+  *fill = NULL;
+  *min = NULL;
+  *max = NULL;
+
+  /* Get details about type and size of netcdf variable */
+  R_nc_check (nc_inq_vartype (ncid, varid, &xtype));
+  if (xtype == NC_CHAR ||
+      xtype == NC_STRING ||
+      xtype > NC_MAX_ATOMIC_TYPE) {
+    /* NetCDF attribute conventions describe the handling of missing values
+       in atomic numeric types. Let users handle other types as needed.
+     */
+    return 0;
+  }
+  R_nc_check (nc_inq_type (ncid, xtype, NULL, &size));
+
+  if (mode == 0 || mode == 1) {
+    if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
+        cnt == 1 &&
+        atype == xtype) {
+      *fill = R_alloc (1, size);
+      R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
+    }
+  } else if (mode == 0 || mode == 2) {
+    if (nc_inq_att (ncid, varid, "missing_value", &atype, &cnt) == NC_NOERR &&
+        cnt == 1 &&
+        atype == xtype) {
+      *fill = R_alloc (1, size);
+      R_nc_check (nc_get_att (ncid, varid, "missing_value", *fill));
+    }
+  } else if (mode == 3) {
+    /* Let user code handle missing values */
+    return 0;
+
+  } else if (mode == 4) {
+
+    /* Special rules apply to byte data */
+    if ((xtype == NC_BYTE) || (xtype == NC_UBYTE)) {
+
+      /* For byte data, valid_range, valid_min and valid_max attributes
+       * may differ from the type of variable, so we read the attributes
+       * with routines that convert to the expected type.
+       */
+      if (nc_inq_att (ncid, varid, "valid_min", &atype, &cnt) == NC_NOERR &&
+          cnt == 1) {
+        *min = R_alloc (1, 1);
+        if (xtype == NC_UBYTE) {
+          R_nc_check (nc_get_att_uchar (ncid, varid, "valid_min", *min));
+        } else {
+          R_nc_check (nc_get_att_schar (ncid, varid, "valid_min", *min));
+        }
+      }
+      if (nc_inq_att (ncid, varid, "valid_max", &atype, &cnt) == NC_NOERR &&
+          cnt == 1) {
+        *max = R_alloc (1, 1);
+        if (xtype == NC_UBYTE) {
+          R_nc_check (nc_get_att_uchar (ncid, varid, "valid_max", *max));
+        } else {
+          R_nc_check (nc_get_att_schar (ncid, varid, "valid_max", *max));
+        }
+      }
+      if (!*min && !*max &&
+          nc_inq_att (ncid, varid, "valid_range", &atype, &cnt) == NC_NOERR &&
+          cnt == 2) {
+        range = R_alloc (2, 1);
+        *min = range;
+        *max = range + 1;
+        if (xtype == NC_UBYTE) {
+          R_nc_check (nc_get_att_uchar (
+                        ncid, varid, "valid_range", (unsigned char *) range));
+        } else {
+          R_nc_check (nc_get_att_schar (
+                        ncid, varid, "valid_range", (signed char *) range));
+        }
+      }
+
+      /* Only set fill value if explicitly defined.
+       * _FillValue attribute should have same type as variable.
+       */
+      if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
+          cnt == 1 &&
+          atype == xtype) {
+        *fill = R_alloc (1, 1);
+        R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
+      }
+
+      /* If _FillValue is defined without a valid range,
+       * set the valid range to exclude _FillValue
+       */
+      if (*fill && !*max && !*min) {
+        if (xtype == NC_UBYTE) {
+          FILL2RANGE_INT(unsigned char)
+        } else {
+          FILL2RANGE_INT(signed char)
+        }
+      }
+
+      /* If a valid range is defined without a fill value,
+       * use the default fill value if it is outside the valid range
+       */
+      if (!*fill && *max) {
+        if (xtype == NC_UBYTE) {
+          if (NC_FILL_UBYTE > **(unsigned char **) max) {
+            *fill = R_alloc(1, 1);
+            **(unsigned char **) fill = NC_FILL_UBYTE;
+          }
+        } else {
+          if (NC_FILL_BYTE > **(signed char **) max) {
+            *fill = R_alloc(1, 1);
+            **(signed char **) fill = NC_FILL_BYTE;
+          }
+        }
+      }
+
+      if (!*fill && *min) {
+        if (xtype == NC_UBYTE) {
+          if (NC_FILL_UBYTE < **(unsigned char **) min) {
+            *fill = R_alloc(1, 1);
+            **(unsigned char **) fill = NC_FILL_UBYTE;
+          }
+        } else {
+          if (NC_FILL_BYTE < **(signed char **) min) {
+            *fill = R_alloc(1, 1);
+            **(signed char **) fill = NC_FILL_BYTE;
+          }
+        }
+      }
+
+    } else {
+      /* All types other than byte data */
+
+      /* Type of valid_* attribute must match type of variable data */
+      if (nc_inq_att (ncid, varid, "valid_min", &atype, &cnt) == NC_NOERR &&
+          cnt == 1 &&
+          atype == xtype) {
+        *min = R_alloc (1, size);
+        R_nc_check (nc_get_att (ncid, varid, "valid_min", *min));
+      }
+      if (nc_inq_att (ncid, varid, "valid_max", &atype, &cnt) == NC_NOERR &&
+          cnt == 1 &&
+          atype == xtype) {
+        *max = R_alloc (1, size);
+        R_nc_check (nc_get_att (ncid, varid, "valid_max", *max));
+      }
+      if (!*min && !*max &&
+          nc_inq_att (ncid, varid, "valid_range", &atype, &cnt) == NC_NOERR &&
+          cnt == 2 &&
+          atype == xtype) {
+        range = R_alloc (2, size);
+        *min = range;
+        *max = range + size;
+        R_nc_check (nc_get_att (ncid, varid, "valid_range", range));
+      }
+
+      /* Get fill value from attribute or use default */
+      if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
+          cnt == 1 &&
+          atype == xtype) {
+        *fill = R_alloc (1, size);
+        R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
+      } else {
+        *fill = R_alloc (1, size);
+        switch (xtype) {
+          case NC_SHORT:
+            **(short **) fill = NC_FILL_SHORT;
+            break;
+          case NC_USHORT:
+            **(unsigned short **) fill = NC_FILL_USHORT;
+            break;
+          case NC_INT:
+            **(int **) fill = NC_FILL_INT;
+            break;
+          case NC_UINT:
+            **(unsigned int **) fill = NC_FILL_UINT;
+            break;
+          case NC_FLOAT:
+            **(float **) fill = NC_FILL_FLOAT;
+            break;
+          case NC_DOUBLE:
+            **(double **) fill = NC_FILL_DOUBLE;
+            break;
+          case NC_INT64:
+            **(long long **) fill = NC_FILL_INT64;
+            break;
+          case NC_UINT64:
+            **(unsigned long long **) fill = NC_FILL_UINT64;
+            break;
+          default:
+            error ("Default fill value not implemented");
+        }
+      }
+
+      /* If _FillValue is defined without a valid range,
+       * set the valid range to exclude _FillValue
+       */
+      if (*fill && !*max && !*min) {
+        switch (xtype) {
+          case NC_SHORT:
+            FILL2RANGE_INT(short);
+            break;
+          case NC_USHORT:
+            FILL2RANGE_INT(unsigned short);
+            break;
+          case NC_INT:
+            FILL2RANGE_INT(int);
+            break;
+          case NC_UINT:
+            FILL2RANGE_INT(unsigned int);
+            break;
+          case NC_INT64:
+            FILL2RANGE_INT(long long);
+            break;
+          case NC_UINT64:
+            FILL2RANGE_INT(unsigned long long);
+            break;
+          case NC_FLOAT:
+            FILL2RANGE_REAL(float, FLT_EPSILON);
+            break;
+          case NC_DOUBLE:
+            FILL2RANGE_REAL(double, DBL_EPSILON);
+            break;
+          default:
+            error ("Default valid range not implemented");
+        }
+      }
+
+    }
+  } else {
+    error ("Unknown mode for handling missing values");
+
+  }
+  return size;
+}
+
+
+void
+R_nc_pack_att (int ncid, int varid, double **scale, double **add)
+{
+  size_t cnt;
+  if (nc_inq_attlen (ncid, varid, "scale_factor", &cnt) != NC_NOERR ||
+        cnt != 1 ||
+        nc_get_att_double (ncid, varid, "scale_factor", *scale) != NC_NOERR ) {
+    *scale = NULL;
+  }
+  if (nc_inq_attlen (ncid, varid, "add_offset", &cnt) != NC_NOERR ||
+    cnt != 1 ||
+    nc_get_att_double (ncid, varid, "add_offset", *add) != NC_NOERR ) {
+    *add = NULL;
+  }
+}
+
@@ -132,5 +132,32 @@ R_NC_DIM_R2C_H (R_nc_dim_r2c_int, int)
 R_NC_DIM_R2C_H (R_nc_dim_r2c_size, size_t)
 
 
+/* Find attributes related to missing values for a netcdf variable.
+   On exit, relevant parameters are returned via double pointers to
+     fill, min and max, which are either NULL or allocated by R_alloc.
+     The function returns the in-memory size (bytes) of a missing value.
+   Argument mode specifies the attributes used for missing values:
+     0 - _FillValue, or missing_value
+     1 - _FillValue only
+     2 - missing_value only
+     3 - none
+     4 - fill value and valid range determined as described at
+         http://www.unidata.ucar.edu/software/netcdf/docs/attribute_conventions.html
+   Example: R_nc_miss_att (ncid, varid, mode, &fill, &min, &max);
+  */
+size_t
+R_nc_miss_att (int ncid, int varid, int mode,
+               void **fill, void **min, void **max);
+
+
+/* Find packing attributes for a given netcdf variable.
+   On entry, pointers for results are passed from caller.
+   On exit, either values are set or pointers are NULLed.
+   Example: R_nc_pack_att (ncid, varid, scalep, addp);
+  */
+void
+R_nc_pack_att (int ncid, int varid, double **scale, double **add);
+
+
 #endif /* RNC_CONVERT_H_INCLUDED */
 
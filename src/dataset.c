@@ -85,7 +85,7 @@ R_nc_format2str (int format)
 SEXP
 R_nc_close (SEXP ptr)
 {
-  int *fileid;
+  int *fileid, status;
 
   if (TYPEOF (ptr) != EXTPTRSXP) {
     error ("Not a valid NetCDF object");
@@ -96,9 +96,15 @@ R_nc_close (SEXP ptr)
     return R_NilValue;
   }
 
+  /* Write buffered records before closing, but report errors after closing */
+  status = R_nc_append_sync (*fileid, 1);
+  R_nc_coord_forget (*fileid, -1);
+  R_nc_cache_free (*fileid);
+  R_nc_name_forget (*fileid);
   R_nc_check (nc_close (*fileid));
   R_Free (fileid);
   R_ClearExternalPtr (ptr);
+  R_nc_check (status);
 
   return R_NilValue;
 }
@@ -119,7 +125,7 @@ R_nc_finalizer (SEXP ptr)
 SEXP
 R_nc_create (SEXP filename, SEXP clobber, SEXP share, SEXP prefill,
              SEXP format, SEXP diskless, SEXP persist,
-             SEXP mpi_comm, SEXP mpi_info)
+             SEXP mpi_comm, SEXP mpi_info, SEXP cache)
 {
   int cmode, fillmode, old_fillmode, ncid, *fileid, icommf, iinfof;
   SEXP Rptr, result;
@@ -196,6 +202,11 @@ R_nc_create (SEXP filename, SEXP clobber, SEXP share, SEXP prefill,
   R_RegisterCFinalizerEx (Rptr, &R_nc_finalizer, TRUE);
   setAttrib (result, install ("handle_ptr"), Rptr);
 
+  /*-- Keep metadata in memory if requested -----------------------------------*/
+  if (asLogical(cache) == TRUE) {
+    R_nc_cache_init (Rptr, ncid);
+  }
+
   /*-- Set the fill mode ------------------------------------------------------*/
   R_nc_check (nc_set_fill (ncid, fillmode, &old_fillmode));
 
@@ -241,13 +252,35 @@ R_nc_inq_file (SEXP nc)
 }
 
 
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_path()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_inq_path (SEXP nc)
+{
+  int ncid;
+  size_t pathlen;
+  char *path;
+
+  /* Get the path (or URL) used to open or create the dataset */
+  ncid = asInteger (nc);
+  R_nc_check (nc_inq_path (ncid, &pathlen, NULL));
+  path = R_alloc (pathlen + 1, sizeof (char));
+  R_nc_check (nc_inq_path (ncid, NULL, path));
+
+  return mkString (path);
+}
+
+
 /*-----------------------------------------------------------------------------*\
  *  R_nc_open()
 \*-----------------------------------------------------------------------------*/
 
 SEXP
 R_nc_open (SEXP filename, SEXP write, SEXP share, SEXP prefill,
-           SEXP diskless, SEXP persist, SEXP mpi_comm, SEXP mpi_info)
+           SEXP diskless, SEXP persist, SEXP mpi_comm, SEXP mpi_info,
+           SEXP cache)
 {
   int ncid, omode, fillmode, old_fillmode, *fileid, icommf, iinfof;
   const char *filep;
@@ -312,6 +345,11 @@ R_nc_open (SEXP filename, SEXP write, SEXP share, SEXP prefill,
   R_RegisterCFinalizerEx (Rptr, &R_nc_finalizer, TRUE);
   setAttrib (result, install ("handle_ptr"), Rptr);
 
+  /*-- Keep metadata in memory if requested -----------------------------------*/
+  if (asLogical(cache) == TRUE) {
+    R_nc_cache_init (Rptr, ncid);
+  }
+
   /*-- Set the fill mode ------------------------------------------------------*/
   if (asLogical(write) == TRUE) {
     R_nc_check (nc_set_fill (ncid, fillmode, &old_fillmode));
@@ -322,6 +360,184 @@ R_nc_open (SEXP filename, SEXP write, SEXP share, SEXP prefill,
 }
 
 
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_scan_file()
+\*-----------------------------------------------------------------------------*/
+
+/* Read the first string of a text attribute as a CHARSXP,
+   or NA_STRING if the attribute is missing or not text.
+ */
+static SEXP
+R_nc_scan_att (int ncid, int varid, const char *attname)
+{
+  nc_type xtype;
+  size_t len;
+  char *text, **strs;
+  SEXP result;
+
+  if (nc_inq_att (ncid, varid, attname, &xtype, &len) != NC_NOERR) {
+    return NA_STRING;
+  }
+  if (xtype == NC_CHAR) {
+    text = R_alloc (len + 1, sizeof (char));
+    if (nc_get_att_text (ncid, varid, attname, text) != NC_NOERR) {
+      return NA_STRING;
+    }
+    text[len] = '\0';
+    return mkChar (text);
+  } else if (xtype == NC_STRING && len > 0) {
+    strs = (char **) R_alloc (len, sizeof (char *));
+    if (nc_get_att (ncid, varid, attname, strs) != NC_NOERR) {
+      return NA_STRING;
+    }
+    result = mkChar (strs[0] ? strs[0] : "");
+    nc_free_string (len, strs);
+    return result;
+  }
+  return NA_STRING;
+}
+
+
+/* Fill the result list of R_nc_scan_file from an open dataset.
+   Result is a netcdf status value.
+ */
+static int
+R_nc_scan_ncid (int ncid, SEXP atts, SEXP timevar, SEXP result)
+{
+  int status, ndims, nvars, ngatts, unlimdimid, format, ii, jj, idim;
+  int vndims, dimids[NC_MAX_VAR_DIMS], timeid, natts;
+  nc_type xtype;
+  size_t dimlen, pos, index;
+  double tfirst, tlast;
+  char name[NC_MAX_NAME+1], *dimstr, *shapestr;
+  SEXP vars;
+
+  /*-- Inquire about the dataset ----------------------------------------------*/
+  status = nc_inq (ncid, &ndims, &nvars, &ngatts, &unlimdimid);
+  if (status == NC_NOERR) {
+    status = nc_inq_format (ncid, &format);
+  }
+  if (status != NC_NOERR) {
+    return status;
+  }
+  SET_VECTOR_ELT (result, 0, mkString (R_nc_format2str (format)));
+  SET_VECTOR_ELT (result, 1, ScalarInteger (ndims));
+  SET_VECTOR_ELT (result, 2, ScalarInteger (nvars));
+  SET_VECTOR_ELT (result, 3, ScalarInteger (ngatts));
+  if (unlimdimid >= 0) {
+    status = nc_inq_dimname (ncid, unlimdimid, name);
+    if (status != NC_NOERR) {
+      return status;
+    }
+    SET_VECTOR_ELT (result, 4, mkString (name));
+  }
+
+  /*-- Find the range of the time coordinate (if any) -------------------------*/
+  dimlen = 0;
+  if (isString (timevar) && xlength (timevar) > 0 &&
+      STRING_ELT (timevar, 0) != NA_STRING &&
+      nc_inq_varid (ncid, CHAR (STRING_ELT (timevar, 0)), &timeid) == NC_NOERR) {
+    status = nc_inq_var (ncid, timeid, NULL, &xtype, &vndims, dimids, NULL);
+    if (status == NC_NOERR && vndims == 1 &&
+        xtype != NC_CHAR && xtype < NC_STRING) {
+      status = nc_inq_dimlen (ncid, dimids[0], &dimlen);
+    }
+    if (status != NC_NOERR) {
+      return status;
+    }
+  }
+  if (dimlen > 0) {
+    /* Coordinates are assumed to be monotonic */
+    index = 0;
+    status = nc_get_var1_double (ncid, timeid, &index, &tfirst);
+    if (status == NC_NOERR) {
+      index = dimlen - 1;
+      status = nc_get_var1_double (ncid, timeid, &index, &tlast);
+    }
+    if (status != NC_NOERR) {
+      return status;
+    }
+    SET_VECTOR_ELT (result, 5, ScalarReal (tfirst < tlast ? tfirst : tlast));
+    SET_VECTOR_ELT (result, 6, ScalarReal (tfirst < tlast ? tlast : tfirst));
+    SET_VECTOR_ELT (result, 7,
+                    ScalarString (R_nc_scan_att (ncid, timeid, "units")));
+  }
+
+  /*-- Inquire about each variable, storing one vector per column -------------*/
+  natts = isString (atts) ? xlength (atts) : 0;
+  vars = PROTECT(allocVector (VECSXP, 4 + natts));
+  for (jj=0; jj<4+natts; jj++) {
+    SET_VECTOR_ELT (vars, jj, allocVector (STRSXP, nvars));
+  }
+  SET_VECTOR_ELT (result, 8, vars);
+  UNPROTECT(1);
+
+  dimstr = R_alloc (NC_MAX_VAR_DIMS * (NC_MAX_NAME+1) + 1, sizeof (char));
+  shapestr = R_alloc (NC_MAX_VAR_DIMS * 24 + 1, sizeof (char));
+  for (ii=0; ii<nvars; ii++) {
+    status = nc_inq_var (ncid, ii, name, &xtype, &vndims, dimids, NULL);
+    if (status != NC_NOERR) {
+      return status;
+    }
+    SET_STRING_ELT (VECTOR_ELT (vars, 0), ii, mkChar (name));
+    status = R_nc_type2str (ncid, xtype, name);
+    if (status != NC_NOERR) {
+      return status;
+    }
+    SET_STRING_ELT (VECTOR_ELT (vars, 1), ii, mkChar (name));
+
+    /* Dimension names and lengths in R order */
+    dimstr[0] = '\0';
+    shapestr[0] = '\0';
+    for (idim=vndims-1, pos=0; idim>=0; idim--) {
+      status = nc_inq_dim (ncid, dimids[idim], name, &dimlen);
+      if (status != NC_NOERR) {
+        return status;
+      }
+      strcat (dimstr, name);
+      pos += sprintf (shapestr + pos, "%.0f", (double) dimlen);
+      if (idim > 0) {
+        strcat (dimstr, ",");
+        pos += sprintf (shapestr + pos, ",");
+      }
+    }
+    SET_STRING_ELT (VECTOR_ELT (vars, 2), ii, mkChar (dimstr));
+    SET_STRING_ELT (VECTOR_ELT (vars, 3), ii, mkChar (shapestr));
+
+    for (jj=0; jj<natts; jj++) {
+      SET_STRING_ELT (VECTOR_ELT (vars, 4+jj), ii,
+        R_nc_scan_att (ncid, ii, CHAR (STRING_ELT (atts, jj))));
+    }
+  }
+
+  return NC_NOERR;
+}
+
+
+SEXP
+R_nc_scan_file (SEXP path, SEXP atts, SEXP timevar)
+{
+  int ncid, status;
+  SEXP result;
+
+  /* Items not found in the dataset remain NULL */
+  result = PROTECT(allocVector (VECSXP, 10));
+
+  /*-- Scan the dataset, returning any error as a string ----------------------*/
+  status = nc_open (R_nc_strarg (path), NC_NOWRITE, &ncid);
+  if (status == NC_NOERR) {
+    status = R_nc_scan_ncid (ncid, atts, timevar, result);
+    nc_close (ncid);
+  }
+  if (status != NC_NOERR) {
+    SET_VECTOR_ELT (result, 9, mkString (nc_strerror (status)));
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
 /*-----------------------------------------------------------------------------*\
  *  R_nc_sync()
 \*-----------------------------------------------------------------------------*/
@@ -331,8 +547,11 @@ R_nc_sync (SEXP nc)
 {
   int ncid;
 
-  /*-- Enter data mode (if necessary) -----------------------------------------*/
+  /*-- Write records buffered by appenders ------------------------------------*/
   ncid = asInteger(nc);
+  R_nc_check (R_nc_append_sync (ncid, 0));
+
+  /*-- Enter data mode (if necessary) -----------------------------------------*/
   R_nc_check( R_nc_enddef (ncid));
 
   /*-- Sync the file ----------------------------------------------------------*/
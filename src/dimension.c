@@ -44,6 +44,7 @@
 #include <netcdf.h>
 
 #include "common.h"
+#include "convert.h"
 #include "RNetCDF.h"
 
 
@@ -83,45 +84,6 @@ R_nc_def_dim (SEXP nc, SEXP dimname, SEXP size, SEXP unlim)
  *  R_nc_inq_unlimids()
 \*-----------------------------------------------------------------------------*/
 
-/* Private function to find unlimited dimensions of a file or group.
-   Returns netcdf status. If no error occurs, nunlim and unlimids are set.
-   Note - some netcdf4 versions only return unlimited dimensions defined in a group,
-     not those defined in the group and its ancestors as claimed in documentation.
- */
-static int
-R_nc_unlimdims (int ncid, int *nunlim, int **unlimids)
-{
-  int status, format;
-
-  *nunlim = 0;
-
-  status = nc_inq_format (ncid, &format);
-  if (status != NC_NOERR) {
-    return status;
-  }
-
-  if (format == NC_FORMAT_NETCDF4) {
-    status = nc_inq_unlimdims (ncid, nunlim, NULL);
-    if (status != NC_NOERR) {
-      return status;
-    }
-
-    *unlimids = (void *) (R_alloc (*nunlim, sizeof (int)));
-
-    status = nc_inq_unlimdims (ncid, NULL, *unlimids);
-
-  } else {
-    *unlimids = (void *) (R_alloc (1, sizeof (int)));
-    status = nc_inq_unlimdim (ncid, *unlimids);
-    if (status == NC_NOERR && **unlimids != -1) {
-      *nunlim = 1;
-    }
-  }
-
-  return status;
-}
-
-
 SEXP
 R_nc_inq_unlimids (SEXP nc)
 {
@@ -162,6 +124,15 @@ R_nc_inq_dim (SEXP nc, SEXP dim)
 
   R_nc_check (R_nc_dim_id (dim, ncid, &dimid, 0));
 
+  /*-- Write appended records that are due, which may extend the dimension ----*/
+  R_nc_check (R_nc_append_expire (ncid));
+
+  /*-- Use cached result (if any) ---------------------------------------------*/
+  result = R_nc_cache_get (ncid, 'd', dimid, 0);
+  if (result) {
+    return result;
+  }
+
   /*-- Inquire the dimension --------------------------------------------------*/
   R_nc_check (nc_inq_dim (ncid, dimid, dimname, &dimlen));
 
@@ -184,6 +155,264 @@ R_nc_inq_dim (SEXP nc, SEXP dim)
   SET_VECTOR_ELT (result, 2, ScalarReal (dimlen));
   SET_VECTOR_ELT (result, 3, ScalarLogical (isunlim));
 
+  /* Lengths of unlimited dimensions change without entering define mode */
+  if (!isunlim) {
+    R_nc_cache_put (ncid, 'd', dimid, 0, result);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_range_dim()
+\*-----------------------------------------------------------------------------*/
+
+/* Maximum length of a coordinate variable that is kept in memory */
+#define RNC_COORD_CACHE_MAXLEN ((size_t) 1048576)
+
+/* Values of a coordinate variable kept for later searches */
+typedef struct R_nc_coord_entry {
+  int ncid, varid;
+  size_t len;
+  double *values;
+  struct R_nc_coord_entry *next;
+} R_nc_coord_entry;
+
+static R_nc_coord_entry *R_nc_coord_cache = NULL;
+
+/* Coordinate variable of a dimension, read from values in memory
+   or one element at a time from the dataset */
+typedef struct {
+  int ncid, varid;
+  size_t len;
+  double scale, add, *scalep, *addp;
+  const double *values;
+} R_nc_coord;
+
+
+void
+R_nc_coord_forget (int ncid, int varid)
+{
+  R_nc_coord_entry **link, *entry;
+  int match;
+
+  link = &R_nc_coord_cache;
+  while ((entry = *link)) {
+    if (varid < 0) {
+      match = (RNC_DATASET_ID (entry->ncid) == RNC_DATASET_ID (ncid));
+    } else {
+      match = (entry->ncid == ncid && entry->varid == varid);
+    }
+    if (match) {
+      *link = entry->next;
+      R_Free (entry->values);
+      R_Free (entry);
+    } else {
+      link = &(entry->next);
+    }
+  }
+}
+
+
+/* Private function to find values of a coordinate variable in memory,
+   reading the whole variable on first use if it is not too long.
+   Values are unpacked before they are stored.
+   Result is NULL if the values are not kept in memory.
+ */
+static const double *
+R_nc_coord_values (R_nc_coord *coord)
+{
+  R_nc_coord_entry *entry;
+  double *values;
+  size_t ii;
+  int status;
+
+  for (entry = R_nc_coord_cache; entry; entry = entry->next) {
+    if (entry->ncid == coord->ncid && entry->varid == coord->varid) {
+      break;
+    }
+  }
+
+  /* Replace values if records have been added since they were read */
+  if (entry && entry->len != coord->len) {
+    R_nc_coord_forget (coord->ncid, coord->varid);
+    entry = NULL;
+  }
+
+  if (!entry && coord->len > 0 && coord->len <= RNC_COORD_CACHE_MAXLEN) {
+    values = R_Calloc (coord->len, double);
+    status = nc_get_var_double (coord->ncid, coord->varid, values);
+    if (status != NC_NOERR) {
+      R_Free (values);
+      R_nc_check (status);
+    }
+    for (ii=0; ii<coord->len; ii++) {
+      if (coord->scalep) {
+        values[ii] *= coord->scale;
+      }
+      if (coord->addp) {
+        values[ii] += coord->add;
+      }
+    }
+
+    entry = R_Calloc (1, R_nc_coord_entry);
+    entry->ncid = coord->ncid;
+    entry->varid = coord->varid;
+    entry->len = coord->len;
+    entry->values = values;
+    entry->next = R_nc_coord_cache;
+    R_nc_coord_cache = entry;
+  }
+
+  return entry ? entry->values : NULL;
+}
+
+
+/* Private function to find the coordinate variable of a dimension,
+   which has the same name as the dimension and no other dimensions.
+   Raise an R error if there is no such variable.
+ */
+static void
+R_nc_coord_init (R_nc_coord *coord, int ncid, int dimid)
+{
+  char dimname[NC_MAX_NAME + 1];
+  int ndims, vardimid;
+  nc_type xtype;
+
+  /* Appended records that are due may extend the dimension */
+  R_nc_check (R_nc_append_expire (ncid));
+  R_nc_check (nc_inq_dim (ncid, dimid, dimname, &(coord->len)));
+
+  coord->ncid = ncid;
+  if (nc_inq_varid (ncid, dimname, &(coord->varid)) != NC_NOERR) {
+    error ("No coordinate variable for dimension %s", dimname);
+  }
+
+  R_nc_check (nc_inq_var (ncid, coord->varid, NULL, &xtype, &ndims, NULL, NULL));
+  if (ndims != 1) {
+    error ("Coordinate variable %s must have one dimension", dimname);
+  }
+  R_nc_check (nc_inq_vardimid (ncid, coord->varid, &vardimid));
+  if (vardimid != dimid) {
+    error ("Coordinate variable %s must have dimension %s", dimname, dimname);
+  }
+  if (xtype == NC_CHAR || xtype == NC_STRING || xtype > NC_MAX_ATOMIC_TYPE) {
+    error ("Coordinate variable %s must be numeric", dimname);
+  }
+
+  coord->scalep = &(coord->scale);
+  coord->addp = &(coord->add);
+  R_nc_pack_att (ncid, coord->varid, &(coord->scalep), &(coord->addp));
+
+  R_nc_check (R_nc_enddef (ncid));
+  coord->values = R_nc_coord_values (coord);
+}
+
+
+/* Private function to read an element of a coordinate variable,
+   applying any packing attributes to values read from the dataset.
+ */
+static double
+R_nc_coord_value (R_nc_coord *coord, size_t index)
+{
+  double value;
+  if (coord->values) {
+    return coord->values[index];
+  }
+  R_nc_check (nc_get_var1_double (coord->ncid, coord->varid, &index, &value));
+  if (coord->scalep) {
+    value *= coord->scale;
+  }
+  if (coord->addp) {
+    value += coord->add;
+  }
+  return value;
+}
+
+
+/* Private function to find the first index of a monotonic coordinate
+   beyond a bound (if strict) or at or beyond a bound (otherwise).
+   Direction is given by sign (1 for ascending, -1 for descending).
+   The search is binary, so only O(log(len)) elements are read
+   from a coordinate variable that is not kept in memory.
+ */
+static size_t
+R_nc_coord_bound (R_nc_coord *coord, int sign, double bound, int strict)
+{
+  size_t lo, hi, mid;
+  double diff;
+
+  lo = 0;
+  hi = coord->len;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    diff = sign * (R_nc_coord_value (coord, mid) - bound);
+    if (diff > 0 || (!strict && diff == 0)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+
+SEXP
+R_nc_range_dim (SEXP nc, SEXP dim, SEXP range)
+{
+  int ncid, dimid, sign;
+  size_t first, end;
+  double lower, upper, tmp;
+  R_nc_coord coord;
+  SEXP result;
+
+  /*-- Convert arguments to netcdf ids ----------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_dim_id (dim, ncid, &dimid, 0));
+
+  if (!isReal (range) || xlength (range) != 2) {
+    error ("Range must be a numeric vector of length 2");
+  }
+  lower = REAL (range)[0];
+  upper = REAL (range)[1];
+  if (ISNAN (lower)) {
+    lower = R_NegInf;
+  }
+  if (ISNAN (upper)) {
+    upper = R_PosInf;
+  }
+  if (lower > upper) {
+    tmp = lower;
+    lower = upper;
+    upper = tmp;
+  }
+
+  /*-- Binary search of the coordinate variable -------------------------------*/
+  R_nc_coord_init (&coord, ncid, dimid);
+
+  first = 0;
+  end = 0;
+  if (coord.len > 0) {
+    if (R_nc_coord_value (&coord, coord.len - 1) >=
+        R_nc_coord_value (&coord, 0)) {
+      sign = 1;
+      first = R_nc_coord_bound (&coord, sign, lower, 0);
+      end = R_nc_coord_bound (&coord, sign, upper, 1);
+    } else {
+      sign = -1;
+      first = R_nc_coord_bound (&coord, sign, upper, 0);
+      end = R_nc_coord_bound (&coord, sign, lower, 1);
+    }
+  }
+
+  /*-- Return start (1-based) and count of matching elements ------------------*/
+  result = PROTECT(allocVector (REALSXP, 2));
+  REAL (result)[0] = first + 1;
+  REAL (result)[1] = (end > first) ? end - first : 0;
+
   UNPROTECT(1);
   return result;
 }
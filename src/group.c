@@ -197,6 +197,296 @@ R_nc_inq_dimids (SEXP nc, SEXP ancestors)
 }
 
 
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_grp_tree()
+\*-----------------------------------------------------------------------------*/
+
+/* Find ids of a group and (optionally) its descendants in depth-first order,
+   storing them in ids (if not NULL) and returning the number of groups.
+   Parents of groups after the first are stored in parents (if not NULL).
+ */
+static int
+R_nc_grp_tree_ids (int ncid, int recursive, int *ids, int *parents)
+{
+  int ngrps, ii, count, *grpids;
+
+  if (ids) {
+    ids[0] = ncid;
+  }
+  count = 1;
+
+  if (recursive && nc_inq_grps (ncid, &ngrps, NULL) == NC_NOERR && ngrps > 0) {
+    grpids = (int *) R_alloc (ngrps, sizeof (int));
+    R_nc_check (nc_inq_grps (ncid, NULL, grpids));
+    for (ii=0; ii<ngrps; ii++) {
+      if (parents) {
+        parents[count] = ncid;
+      }
+      count += R_nc_grp_tree_ids (grpids[ii], recursive,
+                                  ids ? ids + count : NULL,
+                                  parents ? parents + count : NULL);
+    }
+  }
+
+  return count;
+}
+
+
+SEXP
+R_nc_inq_grp_tree (SEXP nc, SEXP ancestors, SEXP recursive)
+{
+  int ncid, isrec, ngrps, ii, *ids, *parents;
+  SEXP result, item, rnc, rtrue, rfalse;
+
+  /*-- Find the group ids -----------------------------------------------------*/
+  ncid = asInteger (nc);
+  isrec = (asLogical (recursive) == TRUE);
+
+  ngrps = R_nc_grp_tree_ids (ncid, isrec, NULL, NULL);
+  ids = (int *) R_alloc (ngrps, sizeof (int));
+  parents = (int *) R_alloc (ngrps, sizeof (int));
+  R_nc_grp_tree_ids (ncid, isrec, ids, parents);
+
+  /* The parent of the first group is NA for the root group */
+  if (nc_inq_grp_parent (ncid, parents) != NC_NOERR) {
+    parents[0] = NA_INTEGER;
+  }
+
+  /*-- Inquire about each group -----------------------------------------------*/
+  rtrue = PROTECT(ScalarLogical (TRUE));
+  rfalse = PROTECT(ScalarLogical (FALSE));
+  result = PROTECT(allocVector (VECSXP, ngrps));
+  for (ii=0; ii<ngrps; ii++) {
+    item = PROTECT(allocVector (VECSXP, 10));
+    SET_VECTOR_ELT (result, ii, item);
+    UNPROTECT(1);
+
+    rnc = PROTECT(ScalarInteger (ids[ii]));
+    SET_VECTOR_ELT (item, 0, rnc);
+    SET_VECTOR_ELT (item, 1, ScalarInteger (parents[ii]));
+    if (nc_inq_grps (ids[ii], NULL, NULL) == NC_NOERR) {
+      SET_VECTOR_ELT (item, 2, R_nc_inq_grps (rnc));
+    } else {
+      SET_VECTOR_ELT (item, 2, allocVector (INTSXP, 0));
+    }
+    SET_VECTOR_ELT (item, 3, R_nc_inq_grpname (rnc, rfalse));
+    SET_VECTOR_ELT (item, 4, R_nc_inq_grpname (rnc, rtrue));
+    SET_VECTOR_ELT (item, 5, R_nc_inq_dimids (rnc, ancestors));
+    SET_VECTOR_ELT (item, 6, R_nc_inq_unlimids (rnc));
+    SET_VECTOR_ELT (item, 7, R_nc_inq_varids (rnc));
+    SET_VECTOR_ELT (item, 8, R_nc_inq_typeids (rnc));
+    SET_VECTOR_ELT (item, 9, R_nc_inq_natts (rnc));
+    UNPROTECT(1);
+  }
+
+  UNPROTECT(3);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_meta()
+\*-----------------------------------------------------------------------------*/
+
+/* Allocate a list with the given element names (not protected) */
+static SEXP
+R_nc_meta_list (int n, const char **names)
+{
+  SEXP result, rnames;
+  int ii;
+
+  result = PROTECT(allocVector (VECSXP, n));
+  rnames = PROTECT(allocVector (STRSXP, n));
+  for (ii=0; ii<n; ii++) {
+    SET_STRING_ELT (rnames, ii, mkChar (names[ii]));
+  }
+  setAttrib (result, R_NamesSymbol, rnames);
+  UNPROTECT(2);
+  return result;
+}
+
+
+/* Name the elements of a list of metadata items by their "name" elements */
+static void
+R_nc_meta_name (SEXP list)
+{
+  SEXP rnames;
+  R_xlen_t ii, n;
+
+  n = xlength (list);
+  rnames = PROTECT(allocVector (STRSXP, n));
+  for (ii=0; ii<n; ii++) {
+    SET_STRING_ELT (rnames, ii,
+      STRING_ELT (VECTOR_ELT (VECTOR_ELT (list, ii), 1), 0));
+  }
+  setAttrib (list, R_NamesSymbol, rnames);
+  UNPROTECT(1);
+}
+
+
+/* Inquire about all attributes of a variable (or NC_GLOBAL),
+   returning results of att.inq.nc with an extra element for the value */
+static SEXP
+R_nc_meta_atts (int ncid, int varid, int natts, SEXP fitnum)
+{
+  static const char *attnames[] = {"id", "name", "type", "length", "value"};
+  SEXP result, rnc, rvar, ratt, rawchar, info, item;
+  int ii, jj;
+
+  rnc = PROTECT(ScalarInteger (ncid));
+  if (varid == NC_GLOBAL) {
+    rvar = PROTECT(mkString ("NC_GLOBAL"));
+  } else {
+    rvar = PROTECT(ScalarInteger (varid));
+  }
+  rawchar = PROTECT(ScalarLogical (FALSE));
+
+  result = PROTECT(allocVector (VECSXP, natts));
+  for (ii=0; ii<natts; ii++) {
+    ratt = PROTECT(ScalarInteger (ii));
+    info = PROTECT(R_nc_inq_att (rnc, rvar, ratt));
+    item = PROTECT(R_nc_meta_list (5, attnames));
+    for (jj=0; jj<4; jj++) {
+      SET_VECTOR_ELT (item, jj, VECTOR_ELT (info, jj));
+    }
+    SET_VECTOR_ELT (item, 4, R_nc_get_att (rnc, rvar, ratt, rawchar, fitnum));
+    SET_VECTOR_ELT (result, ii, item);
+    UNPROTECT(3);
+  }
+  R_nc_meta_name (result);
+
+  UNPROTECT(4);
+  return result;
+}
+
+
+/* Inquire about a group and its descendants */
+static SEXP
+R_nc_meta_grp (int ncid, SEXP fitnum)
+{
+  static const char *grpnames[] = {"self", "name", "dims", "types",
+                                   "vars", "atts", "grps"};
+  static const char *dimnames[] = {"id", "name", "length", "unlim"};
+  static const char *varnames[] = {"id", "name", "type", "ndims", "dimids",
+                                   "natts", "dimnames", "atts"};
+  int ii, jj, nids, *ids, ndims, dimids[NC_MAX_VAR_DIMS], natts;
+  char name[NC_MAX_NAME+1];
+  nc_type xtype;
+  SEXP result, rnc, rfields, list, item, rid, info, rdimids, rdimnames;
+
+  rnc = PROTECT(ScalarInteger (ncid));
+  rfields = PROTECT(ScalarLogical (TRUE));
+
+  result = PROTECT(R_nc_meta_list (7, grpnames));
+  SET_VECTOR_ELT (result, 0, ScalarInteger (ncid));
+  R_nc_check (nc_inq_grpname (ncid, name));
+  SET_VECTOR_ELT (result, 1, mkString (name));
+
+  /*-- Dimensions defined in the group ----------------------------------------*/
+  R_nc_check (nc_inq_dimids (ncid, &nids, NULL, 0));
+  ids = (int *) R_alloc (nids, sizeof (int));
+  R_nc_check (nc_inq_dimids (ncid, NULL, ids, 0));
+  list = PROTECT(allocVector (VECSXP, nids));
+  item = PROTECT(R_nc_meta_list (4, dimnames));
+  for (ii=0; ii<nids; ii++) {
+    rid = PROTECT(ScalarInteger (ids[ii]));
+    info = R_nc_inq_dim (rnc, rid);
+    SET_VECTOR_ELT (list, ii, info);
+    setAttrib (info, R_NamesSymbol, getAttrib (item, R_NamesSymbol));
+    UNPROTECT(1);
+  }
+  R_nc_meta_name (list);
+  SET_VECTOR_ELT (result, 2, list);
+  UNPROTECT(2);
+
+  /*-- Types defined in the group ---------------------------------------------*/
+  R_nc_check (nc_inq_typeids (ncid, &nids, NULL));
+  ids = (int *) R_alloc (nids, sizeof (int));
+  R_nc_check (nc_inq_typeids (ncid, NULL, ids));
+  list = PROTECT(allocVector (VECSXP, nids));
+  for (ii=0; ii<nids; ii++) {
+    rid = PROTECT(ScalarInteger (ids[ii]));
+    SET_VECTOR_ELT (list, ii, R_nc_inq_type (rnc, rid, rfields));
+    UNPROTECT(1);
+  }
+  R_nc_meta_name (list);
+  SET_VECTOR_ELT (result, 3, list);
+  UNPROTECT(1);
+
+  /*-- Variables defined in the group and their attributes --------------------*/
+  R_nc_check (nc_inq_varids (ncid, &nids, NULL));
+  ids = (int *) R_alloc (nids, sizeof (int));
+  R_nc_check (nc_inq_varids (ncid, NULL, ids));
+  list = PROTECT(allocVector (VECSXP, nids));
+  for (ii=0; ii<nids; ii++) {
+    item = PROTECT(R_nc_meta_list (8, varnames));
+    SET_VECTOR_ELT (list, ii, item);
+    UNPROTECT(1);
+
+    R_nc_check (nc_inq_var (ncid, ids[ii], name, &xtype, &ndims, dimids,
+                            &natts));
+    SET_VECTOR_ELT (item, 0, ScalarInteger (ids[ii]));
+    SET_VECTOR_ELT (item, 1, mkString (name));
+    R_nc_check (R_nc_type2str (ncid, xtype, name));
+    SET_VECTOR_ELT (item, 2, mkString (name));
+    SET_VECTOR_ELT (item, 3, ScalarInteger (ndims));
+    SET_VECTOR_ELT (item, 5, ScalarInteger (natts));
+
+    /* Dimension ids and names in reverse (Fortran) order, as var.inq.nc */
+    if (ndims > 0) {
+      rdimids = PROTECT(allocVector (INTSXP, ndims));
+      rdimnames = PROTECT(allocVector (STRSXP, ndims));
+      for (jj=0; jj<ndims; jj++) {
+        INTEGER (rdimids)[ndims-1-jj] = dimids[jj];
+        R_nc_check (nc_inq_dimname (ncid, dimids[jj], name));
+        SET_STRING_ELT (rdimnames, ndims-1-jj, mkChar (name));
+      }
+      SET_VECTOR_ELT (item, 4, rdimids);
+      SET_VECTOR_ELT (item, 6, rdimnames);
+      UNPROTECT(2);
+    } else {
+      SET_VECTOR_ELT (item, 4, ScalarInteger (NA_INTEGER));
+      SET_VECTOR_ELT (item, 6, allocVector (STRSXP, 0));
+    }
+
+    SET_VECTOR_ELT (item, 7, R_nc_meta_atts (ncid, ids[ii], natts, fitnum));
+  }
+  R_nc_meta_name (list);
+  SET_VECTOR_ELT (result, 4, list);
+  UNPROTECT(1);
+
+  /*-- Group attributes -------------------------------------------------------*/
+  R_nc_check (nc_inq_natts (ncid, &natts));
+  SET_VECTOR_ELT (result, 5, R_nc_meta_atts (ncid, NC_GLOBAL, natts, fitnum));
+
+  /*-- Groups within the group (none for classic formats) ---------------------*/
+  if (nc_inq_grps (ncid, &nids, NULL) != NC_NOERR) {
+    nids = 0;
+  }
+  ids = (int *) R_alloc (nids, sizeof (int));
+  if (nids > 0) {
+    R_nc_check (nc_inq_grps (ncid, NULL, ids));
+  }
+  list = PROTECT(allocVector (VECSXP, nids));
+  for (ii=0; ii<nids; ii++) {
+    SET_VECTOR_ELT (list, ii, R_nc_meta_grp (ids[ii], fitnum));
+  }
+  R_nc_meta_name (list);
+  SET_VECTOR_ELT (result, 6, list);
+  UNPROTECT(1);
+
+  UNPROTECT(3);
+  return result;
+}
+
+
+SEXP
+R_nc_inq_meta (SEXP nc, SEXP fitnum)
+{
+  return R_nc_meta_grp (asInteger (nc), fitnum);
+}
+
+
 /*-----------------------------------------------------------------------------*\
  *  R_nc_rename_grp()
 \*-----------------------------------------------------------------------------*/
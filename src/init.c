@@ -44,13 +44,19 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_nc_put_att", (DL_FUNC) &R_nc_put_att, 5},
   {"R_nc_rename_att", (DL_FUNC) &R_nc_rename_att, 4},
   {"R_nc_close", (DL_FUNC) &R_nc_close, 1},
-  {"R_nc_create", (DL_FUNC) &R_nc_create, 9},
+  {"R_nc_create", (DL_FUNC) &R_nc_create, 10},
   {"R_nc_inq_file", (DL_FUNC) &R_nc_inq_file, 1},
-  {"R_nc_open", (DL_FUNC) &R_nc_open, 8},
+  {"R_nc_inq_path", (DL_FUNC) &R_nc_inq_path, 1},
+  {"R_nc_open", (DL_FUNC) &R_nc_open, 9},
+  {"R_nc_scan_file", (DL_FUNC) &R_nc_scan_file, 3},
   {"R_nc_sync", (DL_FUNC) &R_nc_sync, 1},
+  {"R_nc_def_append", (DL_FUNC) &R_nc_def_append, 6},
+  {"R_nc_put_append", (DL_FUNC) &R_nc_put_append, 2},
+  {"R_nc_sync_append", (DL_FUNC) &R_nc_sync_append, 1},
   {"R_nc_def_dim", (DL_FUNC) &R_nc_def_dim, 4},
   {"R_nc_inq_dim", (DL_FUNC) &R_nc_inq_dim, 2},
   {"R_nc_inq_unlimids", (DL_FUNC) &R_nc_inq_unlimids, 1},
+  {"R_nc_range_dim", (DL_FUNC) &R_nc_range_dim, 3},
   {"R_nc_rename_dim", (DL_FUNC) &R_nc_rename_dim, 3},
   {"R_nc_def_grp", (DL_FUNC) &R_nc_def_grp, 2},
   {"R_nc_inq_grp_parent", (DL_FUNC) &R_nc_inq_grp_parent, 1},
@@ -61,7 +67,13 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_nc_inq_typeids", (DL_FUNC) &R_nc_inq_typeids, 1},
   {"R_nc_inq_varids", (DL_FUNC) &R_nc_inq_varids, 1},
   {"R_nc_inq_dimids", (DL_FUNC) &R_nc_inq_dimids, 2},
+  {"R_nc_inq_grp_tree", (DL_FUNC) &R_nc_inq_grp_tree, 3},
+  {"R_nc_inq_meta", (DL_FUNC) &R_nc_inq_meta, 2},
   {"R_nc_rename_grp", (DL_FUNC) &R_nc_rename_grp, 2},
+  {"R_nc_filter_var", (DL_FUNC) &R_nc_filter_var, 8},
+  {"R_nc_hist_var", (DL_FUNC) &R_nc_hist_var, 8},
+  {"R_nc_quantile_var", (DL_FUNC) &R_nc_quantile_var, 8},
+  {"R_nc_reduce_var", (DL_FUNC) &R_nc_reduce_var, 9},
   {"R_nc_def_type", (DL_FUNC) &R_nc_def_type, 9},
   {"R_nc_inq_type", (DL_FUNC) &R_nc_inq_type, 3},
   {"R_nc_calendar", (DL_FUNC) &R_nc_calendar, 2},
@@ -71,8 +83,14 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_nc_def_var", (DL_FUNC) &R_nc_def_var, 12},
   {"R_nc_get_var", (DL_FUNC) &R_nc_get_var, 11},
   {"R_nc_inq_var", (DL_FUNC) &R_nc_inq_var, 2},
+  {"R_nc_inq_var_dimlen", (DL_FUNC) &R_nc_inq_var_dimlen, 2},
+  {"R_nc_inq_vars", (DL_FUNC) &R_nc_inq_vars, 3},
+  {"R_nc_iter_next", (DL_FUNC) &R_nc_iter_next, 1},
+  {"R_nc_iter_var", (DL_FUNC) &R_nc_iter_var, 10},
   {"R_nc_par_var", (DL_FUNC) &R_nc_par_var, 3},
   {"R_nc_put_var", (DL_FUNC) &R_nc_put_var, 10},
+  {"R_nc_put_vars", (DL_FUNC) &R_nc_put_vars, 7},
+  {"R_nc_scatter_var", (DL_FUNC) &R_nc_scatter_var, 6},
   {"R_nc_rename_var", (DL_FUNC) &R_nc_rename_var, 3},
   {NULL, NULL, 0}
 };
@@ -0,0 +1,1156 @@
+/*=============================================================================*\
+ *
+ *  Name:       reduce.c
+ *
+ *  Version:    2.4-1
+ *
+ *  Purpose:    Streaming reductions of NetCDF variables for RNetCDF
+ *
+ *  Author:     Pavel Michna (rnetcdf-devel@bluewin.ch)
+ *              Milton Woods (miltonjwoods@gmail.com)
+ *
+ *  Copyright:  (C) 2004-2020 Pavel Michna, Milton Woods
+ *
+ *=============================================================================*
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *=============================================================================*
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <netcdf.h>
+
+#include "common.h"
+#include "convert.h"
+#include "RNetCDF.h"
+
+
+/*=============================================================================*\
+ *  Block access to a hyperslab.
+\*=============================================================================*/
+
+/* Maximum number of elements in a block read from a variable */
+#define RNC_BLOCK_MAXLEN ((size_t) 1048576)
+
+/* State of a traversal of a hyperslab in blocks.
+   The hyperslab (start, count) and block grid (origin, step) are in C order.
+   Blocks of chunked variables are aligned with chunk boundaries.
+   The current block has offset bstart from start and lengths bcount.
+ */
+typedef struct {
+  int ncid, varid, ndims, done;
+  nc_type xtype;
+  size_t *start, *count, *origin, *step, *bstart, *bcount;
+  void *fill, *min, *max;
+  size_t fillsize;
+  double scale, add, *scalep, *addp;
+} R_nc_blocks;
+
+
+/* Prepare to read a hyperslab of a numeric variable in blocks.
+   Arguments start and count are R vectors of 1-based indices (R order).
+ */
+static void
+R_nc_blocks_init (R_nc_blocks *blk, int ncid, int varid,
+                  SEXP start, SEXP count, int namode, int unpack)
+{
+  int ndims, idim, storeprop;
+  size_t len;
+
+  blk->ncid = ncid;
+  blk->varid = varid;
+  R_nc_check (nc_inq_var (ncid, varid, NULL, &(blk->xtype), &ndims,
+                          NULL, NULL));
+  blk->ndims = ndims;
+
+  if (blk->xtype == NC_CHAR || blk->xtype == NC_STRING ||
+      blk->xtype > NC_MAX_ATOMIC_TYPE) {
+    error ("Variable must have a numeric type");
+  }
+
+  /*-- Convert start and count from R to C indices ----------------------------*/
+  if (ndims > 0) {
+    blk->start = R_nc_dim_r2c_size (start, ndims, 0);
+    blk->count = R_nc_dim_r2c_size (count, ndims, 0);
+    for (idim=0; idim<ndims; idim++) {
+      blk->start[idim] -= 1;
+    }
+  } else {
+    blk->start = NULL;
+    blk->count = NULL;
+  }
+
+  /*-- Define the block grid --------------------------------------------------*/
+  blk->origin = (size_t *) R_alloc (ndims, sizeof (size_t));
+  blk->step = (size_t *) R_alloc (ndims, sizeof (size_t));
+  blk->bstart = (size_t *) R_alloc (ndims, sizeof (size_t));
+  blk->bcount = (size_t *) R_alloc (ndims, sizeof (size_t));
+
+  storeprop = NC_CONTIGUOUS;
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  if (ndims > 0 &&
+      nc_inq_var_chunking (ncid, varid, &storeprop, NULL) == NC_NOERR &&
+      storeprop == NC_CHUNKED) {
+    R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, blk->step));
+  }
+#endif
+  if (storeprop == NC_CHUNKED) {
+    len = 1;
+    for (idim=0; idim<ndims; idim++) {
+      blk->origin[idim] = 0;
+      len *= (blk->step[idim] < blk->count[idim]) ?
+               blk->step[idim] : blk->count[idim];
+    }
+    /* Divide large chunks into bands along the slowest dimensions */
+    for (idim=0; idim<ndims && len>RNC_BLOCK_MAXLEN; idim++) {
+      if (blk->step[idim] > blk->count[idim]) {
+        blk->step[idim] = blk->count[idim];
+      }
+      len /= blk->step[idim];
+      blk->step[idim] /= (len * blk->step[idim] + RNC_BLOCK_MAXLEN - 1) /
+                           RNC_BLOCK_MAXLEN;
+      if (blk->step[idim] < 1) {
+        blk->step[idim] = 1;
+      }
+      len *= blk->step[idim];
+    }
+  } else {
+    /* Read whole rows of the fastest dimensions, up to a maximum length */
+    len = 1;
+    for (idim=ndims-1; idim>=0; idim--) {
+      blk->origin[idim] = blk->start[idim];
+      if (len * blk->count[idim] <= RNC_BLOCK_MAXLEN) {
+        blk->step[idim] = blk->count[idim];
+      } else {
+        blk->step[idim] = RNC_BLOCK_MAXLEN / len;
+      }
+      if (blk->step[idim] < 1) {
+        blk->step[idim] = 1;
+      }
+      len *= blk->step[idim];
+    }
+  }
+
+  for (idim=0; idim<ndims; idim++) {
+    blk->bstart[idim] = 0;
+  }
+  blk->done = (R_nc_length (ndims, blk->count) == 0);
+
+  /*-- Get fill and packing attributes (if any) -------------------------------*/
+  blk->fill = NULL;
+  blk->min = NULL;
+  blk->max = NULL;
+  blk->fillsize = R_nc_miss_att (ncid, varid, namode,
+                                 &(blk->fill), &(blk->min), &(blk->max));
+  blk->scalep = NULL;
+  blk->addp = NULL;
+  if (unpack) {
+    blk->scalep = &(blk->scale);
+    blk->addp = &(blk->add);
+    R_nc_pack_att (ncid, varid, &(blk->scalep), &(blk->addp));
+  }
+
+  /*-- Enter data mode and write appended records that are due ----------------*/
+  R_nc_check (R_nc_enddef (ncid));
+  R_nc_check (R_nc_append_expire (ncid));
+}
+
+
+/* Read the current block as a double precision R vector,
+   with missing values converted to NA and optional unpacking.
+   On exit, blk->bcount contains the lengths of the block.
+   The result should be PROTECTed by the caller.
+ */
+static SEXP
+R_nc_blocks_read (R_nc_blocks *blk)
+{
+  int idim, ndims;
+  size_t *astart, pos, end, limit;
+  R_nc_buf io;
+  void *cbuf;
+  SEXP result;
+  const void *vmax;
+
+  vmax = vmaxget ();
+  ndims = blk->ndims;
+
+  /* Block ends at the next grid boundary or the end of the hyperslab */
+  astart = (size_t *) R_alloc (ndims, sizeof (size_t));
+  for (idim=0; idim<ndims; idim++) {
+    pos = blk->start[idim] + blk->bstart[idim];
+    end = blk->origin[idim] +
+            ((pos - blk->origin[idim]) / blk->step[idim] + 1) * blk->step[idim];
+    limit = blk->start[idim] + blk->count[idim];
+    blk->bcount[idim] = ((end < limit) ? end : limit) - pos;
+    astart[idim] = pos;
+  }
+
+  cbuf = NULL;
+  result = PROTECT(R_nc_c2r_init (&io, &cbuf, blk->ncid, blk->xtype,
+                     ndims, blk->bcount, 0, 0, blk->fillsize,
+                     blk->fill, blk->min, blk->max, blk->scalep, blk->addp));
+  R_nc_check (nc_get_vara (blk->ncid, blk->varid, astart, blk->bcount, cbuf));
+  R_nc_c2r (&io);
+
+  /* Release temporary buffers, which are not needed after conversion */
+  vmaxset (vmax);
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/* Move to the next block in C order, setting blk->done after the last block.
+ */
+static void
+R_nc_blocks_advance (R_nc_blocks *blk)
+{
+  int idim;
+  for (idim=blk->ndims-1; idim>=0; idim--) {
+    blk->bstart[idim] += blk->bcount[idim];
+    if (blk->bstart[idim] < blk->count[idim]) {
+      return;
+    }
+    blk->bstart[idim] = 0;
+  }
+  blk->done = 1;
+}
+
+
+/*=============================================================================*\
+ *  Accumulation of statistics over cells of an output array.
+\*=============================================================================*/
+
+/* Statistics computed by R_nc_reduce_var.
+   RNC_STAT_RANGE gives the minimum and maximum of each output cell.
+ */
+typedef enum {
+  RNC_STAT_SUM, RNC_STAT_MEAN, RNC_STAT_MIN, RNC_STAT_MAX,
+  RNC_STAT_COUNT, RNC_STAT_VAR, RNC_STAT_RANGE
+} R_nc_stat;
+
+/* Accumulators for each cell of the output array.
+   Elements of the input hyperslab are mapped to output cells by dividing
+   their offsets from the start of the hyperslab by factor (C order).
+   A factor of 0 on input to R_nc_accum_init reduces a whole dimension.
+   Array members that are not needed by a statistic are NULL.
+ */
+typedef struct {
+  R_nc_stat stat;
+  int ndims, narm;
+  size_t ncell;
+  size_t *factor, *ocount, *ostride, *index;
+  double *n, *nmiss, *sum, *m2, *min, *max;
+} R_nc_accum;
+
+
+static R_nc_stat
+R_nc_str2stat (SEXP stat)
+{
+  if (R_nc_strcmp (stat, "sum")) {
+    return RNC_STAT_SUM;
+  } else if (R_nc_strcmp (stat, "mean")) {
+    return RNC_STAT_MEAN;
+  } else if (R_nc_strcmp (stat, "min")) {
+    return RNC_STAT_MIN;
+  } else if (R_nc_strcmp (stat, "max")) {
+    return RNC_STAT_MAX;
+  } else if (R_nc_strcmp (stat, "count")) {
+    return RNC_STAT_COUNT;
+  } else if (R_nc_strcmp (stat, "var")) {
+    return RNC_STAT_VAR;
+  } else if (R_nc_strcmp (stat, "range")) {
+    return RNC_STAT_RANGE;
+  } else {
+    error ("Unknown statistic");
+  }
+}
+
+
+/* Allocate a zeroed double array of length n, or NULL if not needed */
+static double *
+R_nc_accum_alloc (int needed, size_t n, double init)
+{
+  double *data;
+  size_t ii;
+  if (!needed) {
+    return NULL;
+  }
+  data = (double *) R_alloc (n, sizeof (double));
+  for (ii=0; ii<n; ii++) {
+    data[ii] = init;
+  }
+  return data;
+}
+
+
+static void
+R_nc_accum_init (R_nc_accum *acc, R_nc_stat stat, int narm,
+                 int ndims, const size_t *count, const size_t *factor)
+{
+  int idim;
+  R_nc_stat ss;
+
+  acc->stat = ss = stat;
+  acc->narm = narm;
+  acc->ndims = ndims;
+  acc->factor = (size_t *) R_alloc (ndims, sizeof (size_t));
+  acc->ocount = (size_t *) R_alloc (ndims, sizeof (size_t));
+  acc->ostride = (size_t *) R_alloc (ndims, sizeof (size_t));
+  acc->index = (size_t *) R_alloc (ndims, sizeof (size_t));
+
+  acc->ncell = 1;
+  for (idim=ndims-1; idim>=0; idim--) {
+    if (factor[idim] > 0) {
+      acc->factor[idim] = factor[idim];
+      acc->ocount[idim] = (count[idim] + factor[idim] - 1) / factor[idim];
+    } else {
+      /* Reduce over the whole dimension, even if it is empty */
+      acc->factor[idim] = (count[idim] > 0) ? count[idim] : 1;
+      acc->ocount[idim] = 1;
+    }
+    acc->ostride[idim] = acc->ncell;
+    acc->ncell *= acc->ocount[idim];
+  }
+
+  acc->n = R_nc_accum_alloc (1, acc->ncell, 0.0);
+  acc->nmiss = R_nc_accum_alloc (!narm, acc->ncell, 0.0);
+  acc->sum = R_nc_accum_alloc (ss == RNC_STAT_SUM || ss == RNC_STAT_MEAN ||
+                               ss == RNC_STAT_VAR, acc->ncell, 0.0);
+  acc->m2 = R_nc_accum_alloc (ss == RNC_STAT_VAR, acc->ncell, 0.0);
+  acc->min = R_nc_accum_alloc (ss == RNC_STAT_MIN || ss == RNC_STAT_RANGE,
+                               acc->ncell, R_PosInf);
+  acc->max = R_nc_accum_alloc (ss == RNC_STAT_MAX || ss == RNC_STAT_RANGE,
+                               acc->ncell, R_NegInf);
+}
+
+
+/* Accumulate a run of nv contiguous values into output cell icell.
+ */
+static void
+R_nc_accum_run (R_nc_accum *acc, size_t icell, const double *v, size_t nv)
+{
+  size_t ii, nb, nmiss;
+  double xx, sb, mb, m2b, mn, mx, na, delta;
+
+  nb = 0;
+  sb = 0.0;
+  mn = R_PosInf;
+  mx = R_NegInf;
+  for (ii=0; ii<nv; ii++) {
+    xx = v[ii];
+    if (!ISNAN(xx)) {
+      nb++;
+      sb += xx;
+      mn = (xx < mn) ? xx : mn;
+      mx = (xx > mx) ? xx : mx;
+    }
+  }
+  nmiss = nv - nb;
+
+  if (acc->nmiss) {
+    acc->nmiss[icell] += nmiss;
+  }
+  if (nb == 0) {
+    return;
+  }
+
+  if (acc->m2) {
+    /* Combine variance of the run with the cell (Chan et al., 1979) */
+    mb = sb / nb;
+    m2b = 0.0;
+    for (ii=0; ii<nv; ii++) {
+      xx = v[ii];
+      if (!ISNAN(xx)) {
+        m2b += (xx - mb) * (xx - mb);
+      }
+    }
+    na = acc->n[icell];
+    if (na > 0) {
+      delta = mb - acc->sum[icell] / na;
+      acc->m2[icell] += m2b + delta * delta * na * nb / (na + nb);
+    } else {
+      acc->m2[icell] = m2b;
+    }
+  }
+
+  acc->n[icell] += nb;
+  if (acc->sum) {
+    acc->sum[icell] += sb;
+  }
+  if (acc->min && mn < acc->min[icell]) {
+    acc->min[icell] = mn;
+  }
+  if (acc->max && mx > acc->max[icell]) {
+    acc->max[icell] = mx;
+  }
+}
+
+
+/* Accumulate a block of values (C order) with offset bstart
+   from the start of the hyperslab and lengths bcount.
+ */
+static void
+R_nc_accum_block (R_nc_accum *acc, const double *values,
+                  const size_t *bstart, const size_t *bcount)
+{
+  int ndims, idim, inner;
+  size_t *index, nrow, irow, icell, pos, end, next, fac;
+  const double *row;
+
+  ndims = acc->ndims;
+  if (ndims == 0) {
+    R_nc_accum_run (acc, 0, values, 1);
+    return;
+  }
+
+  /* Iterate over rows along the fastest dimension */
+  inner = ndims - 1;
+  nrow = 1;
+  for (idim=0; idim<inner; idim++) {
+    nrow *= bcount[idim];
+  }
+  if (nrow == 0 || bcount[inner] == 0) {
+    return;
+  }
+
+  index = acc->index;
+  for (idim=0; idim<ndims; idim++) {
+    index[idim] = 0;
+  }
+
+  fac = acc->factor[inner];
+  for (irow=0, row=values; irow<nrow; irow++, row+=bcount[inner]) {
+    /* Output cell for the start of the row */
+    icell = 0;
+    for (idim=0; idim<inner; idim++) {
+      icell += ((bstart[idim] + index[idim]) / acc->factor[idim]) *
+                 acc->ostride[idim];
+    }
+
+    /* Split row into runs that map to the same output cell */
+    pos = bstart[inner];
+    end = pos + bcount[inner];
+    while (pos < end) {
+      next = (pos / fac + 1) * fac;
+      next = (next < end) ? next : end;
+      R_nc_accum_run (acc, icell + (pos / fac) * acc->ostride[inner],
+                      row + (pos - bstart[inner]), next - pos);
+      pos = next;
+    }
+
+    /* Increment index of the row */
+    for (idim=inner-1; idim>=0; idim--) {
+      if (++index[idim] < bcount[idim]) {
+        break;
+      }
+      index[idim] = 0;
+    }
+  }
+}
+
+
+/* Store the statistic of each output cell in a double array.
+   For RNC_STAT_RANGE, the minimum and maximum of each cell are stored
+   in consecutive elements.
+ */
+static void
+R_nc_accum_result (const R_nc_accum *acc, double *out)
+{
+  size_t ii;
+  double nn;
+
+  for (ii=0; ii<acc->ncell; ii++) {
+    nn = acc->n[ii];
+    if (acc->stat == RNC_STAT_RANGE) {
+      if ((acc->nmiss && acc->nmiss[ii] > 0) || nn == 0) {
+        out[2*ii] = NA_REAL;
+        out[2*ii+1] = NA_REAL;
+      } else {
+        out[2*ii] = acc->min[ii];
+        out[2*ii+1] = acc->max[ii];
+      }
+      continue;
+    }
+    if (acc->stat != RNC_STAT_COUNT && acc->nmiss && acc->nmiss[ii] > 0) {
+      out[ii] = NA_REAL;
+      continue;
+    }
+    switch (acc->stat) {
+    case RNC_STAT_SUM:
+      out[ii] = acc->sum[ii];
+      break;
+    case RNC_STAT_MEAN:
+      out[ii] = (nn > 0) ? acc->sum[ii] / nn : NA_REAL;
+      break;
+    case RNC_STAT_MIN:
+      out[ii] = (nn > 0) ? acc->min[ii] : NA_REAL;
+      break;
+    case RNC_STAT_MAX:
+      out[ii] = (nn > 0) ? acc->max[ii] : NA_REAL;
+      break;
+    case RNC_STAT_COUNT:
+      out[ii] = nn;
+      break;
+    case RNC_STAT_VAR:
+      out[ii] = (nn > 1) ? acc->m2[ii] / (nn - 1) : NA_REAL;
+      break;
+    case RNC_STAT_RANGE:
+      break;
+    }
+  }
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_reduce_var()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_reduce_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP factor,
+                 SEXP stat, SEXP narm, SEXP namode, SEXP unpack)
+{
+  int ncid, varid, idim;
+  size_t *cfactor, *ocount;
+  R_nc_blocks blk;
+  R_nc_accum acc;
+  SEXP result, values;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  R_nc_blocks_init (&blk, ncid, varid, start, count,
+                    asInteger (namode), asLogical (unpack) == TRUE);
+
+  cfactor = NULL;
+  if (blk.ndims > 0) {
+    cfactor = R_nc_dim_r2c_size (factor, blk.ndims, 1);
+  }
+
+  R_nc_accum_init (&acc, R_nc_str2stat (stat), asLogical (narm) == TRUE,
+                   blk.ndims, blk.count, cfactor);
+
+  /*-- Accumulate statistics block by block -----------------------------------*/
+  while (!blk.done) {
+    values = PROTECT(R_nc_blocks_read (&blk));
+    R_nc_accum_block (&acc, REAL (values), blk.bstart, blk.bcount);
+    UNPROTECT(1);
+    R_nc_blocks_advance (&blk);
+  }
+
+  /*-- Return statistics with dimensions of the output array ------------------*/
+  if (acc.stat == RNC_STAT_RANGE) {
+    /* Minimum and maximum vary fastest (first dimension in R order) */
+    ocount = (size_t *) R_alloc (blk.ndims + 1, sizeof (size_t));
+    for (idim=0; idim<blk.ndims; idim++) {
+      ocount[idim] = acc.ocount[idim];
+    }
+    ocount[blk.ndims] = 2;
+    result = PROTECT(R_nc_allocArray (REALSXP, blk.ndims + 1, ocount));
+  } else {
+    result = PROTECT(R_nc_allocArray (REALSXP, blk.ndims, acc.ocount));
+  }
+  R_nc_accum_result (&acc, REAL (result));
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*=============================================================================*\
+ *  Histograms and quantile sketches.
+\*=============================================================================*/
+
+/* Find the bin of x in increasing breaks[0..nbreak-1] by binary search.
+   Bins are (breaks[i], breaks[i+1]] if right is true, with the lowest bin
+   closed on the left, or [breaks[i], breaks[i+1]) otherwise, with the
+   highest bin closed on the right.
+   Result is -1 if x is below the lowest break, or nbreak-1 if x is above
+   the highest break.
+ */
+static long
+R_nc_hist_bin (double x, const double *breaks, size_t nbreak, int right)
+{
+  size_t lo, hi, mid;
+  if (x < breaks[0]) {
+    return -1;
+  } else if (x > breaks[nbreak-1]) {
+    return nbreak - 1;
+  } else if (right && x == breaks[0]) {
+    return 0;
+  } else if (!right && x == breaks[nbreak-1]) {
+    return nbreak - 2;
+  }
+  /* Invariant: x lies in the half-open interval (breaks[lo], breaks[hi]]
+     if right is true, or [breaks[lo], breaks[hi]) otherwise */
+  lo = 0;
+  hi = nbreak - 1;
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (right ? (x <= breaks[mid]) : (x < breaks[mid])) {
+      hi = mid;
+    } else {
+      lo = mid;
+    }
+  }
+  return lo;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_hist_var()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_hist_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP breaks,
+               SEXP right, SEXP namode, SEXP unpack)
+{
+  int ncid, varid, iright;
+  size_t nbreak, nbin, ii, nval;
+  long ibin;
+  double *cbreaks, *bins, below, above, missing, xx;
+  const double *vv;
+  R_nc_blocks blk;
+  SEXP result, counts, values;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  nbreak = xlength (breaks);
+  if (!isReal (breaks) || nbreak < 2) {
+    error ("Histogram requires at least two breaks");
+  }
+  cbreaks = REAL (breaks);
+  for (ii=1; ii<nbreak; ii++) {
+    if (!(cbreaks[ii] > cbreaks[ii-1])) {
+      error ("Histogram breaks must be strictly increasing");
+    }
+  }
+  iright = (asLogical (right) == TRUE);
+
+  R_nc_blocks_init (&blk, ncid, varid, start, count,
+                    asInteger (namode), asLogical (unpack) == TRUE);
+
+  /*-- Count values in each bin block by block --------------------------------*/
+  nbin = nbreak - 1;
+  counts = PROTECT(allocVector (REALSXP, nbin));
+  bins = REAL (counts);
+  for (ii=0; ii<nbin; ii++) {
+    bins[ii] = 0.0;
+  }
+  below = 0.0;
+  above = 0.0;
+  missing = 0.0;
+
+  while (!blk.done) {
+    values = PROTECT(R_nc_blocks_read (&blk));
+    vv = REAL (values);
+    nval = xlength (values);
+    for (ii=0; ii<nval; ii++) {
+      xx = vv[ii];
+      if (ISNAN(xx)) {
+        missing++;
+        continue;
+      }
+      ibin = R_nc_hist_bin (xx, cbreaks, nbreak, iright);
+      if (ibin < 0) {
+        below++;
+      } else if ((size_t) ibin >= nbin) {
+        above++;
+      } else {
+        bins[ibin]++;
+      }
+    }
+    UNPROTECT(1);
+    R_nc_blocks_advance (&blk);
+  }
+
+  /*-- Return counts in a list ------------------------------------------------*/
+  result = PROTECT(allocVector (VECSXP, 4));
+  SET_VECTOR_ELT (result, 0, counts);
+  SET_VECTOR_ELT (result, 1, ScalarReal (below));
+  SET_VECTOR_ELT (result, 2, ScalarReal (above));
+  SET_VECTOR_ELT (result, 3, ScalarReal (missing));
+
+  UNPROTECT(2);
+  return result;
+}
+
+
+/* Merging t-digest (Dunning and Ertl, 2019) for approximate quantiles.
+   Values are collected in buf, which is merged with the sorted centroids
+   when it is full. The size of each centroid is limited by the scale function
+   k(q) = compression / (2 pi) * asin (2q - 1), so that centroids are small
+   near the tails of the distribution. At most ceil(compression)+2 centroids
+   are retained after each merge.
+   All arrays are allocated by R_alloc when the digest is initialised.
+ */
+typedef struct {
+  double compression, total, min, max;
+  size_t ncent, nbuf, maxbuf;
+  double *mean, *weight, *tmean, *tweight, *buf;
+} R_nc_tdigest;
+
+
+static void
+R_nc_tdigest_init (R_nc_tdigest *td, double compression)
+{
+  size_t maxcent;
+  td->compression = compression;
+  td->total = 0.0;
+  td->min = R_PosInf;
+  td->max = R_NegInf;
+  td->ncent = 0;
+  td->nbuf = 0;
+  td->maxbuf = 5 * (size_t) ceil (compression);
+  maxcent = (size_t) ceil (compression) + 2 + td->maxbuf;
+  td->mean = (double *) R_alloc (maxcent, sizeof (double));
+  td->weight = (double *) R_alloc (maxcent, sizeof (double));
+  td->tmean = (double *) R_alloc (maxcent, sizeof (double));
+  td->tweight = (double *) R_alloc (maxcent, sizeof (double));
+  td->buf = (double *) R_alloc (td->maxbuf, sizeof (double));
+}
+
+
+/* Quantile at the upper limit of a centroid that starts at quantile q0 */
+static double
+R_nc_tdigest_qlimit (const R_nc_tdigest *td, double q0)
+{
+  double kk;
+  kk = td->compression / (2 * M_PI) * asin (2 * q0 - 1) + 1;
+  if (kk >= td->compression / 4) {
+    return 1.0;
+  }
+  return (sin (kk * 2 * M_PI / td->compression) + 1) / 2;
+}
+
+
+/* Merge buffered values into the centroids */
+static void
+R_nc_tdigest_merge (R_nc_tdigest *td)
+{
+  size_t ic, ib, nout;
+  double total, wsofar, qlimit, xm, xw, *swap;
+
+  if (td->nbuf == 0) {
+    return;
+  }
+  R_qsort (td->buf, 1, td->nbuf);
+
+  total = td->total + td->nbuf;
+  ic = 0;
+  ib = 0;
+  nout = 0;
+  wsofar = 0.0;
+  qlimit = R_nc_tdigest_qlimit (td, 0.0);
+
+  while (ic < td->ncent || ib < td->nbuf) {
+    /* Take the next centroid or value in order of increasing mean */
+    if (ib >= td->nbuf ||
+        (ic < td->ncent && td->mean[ic] <= td->buf[ib])) {
+      xm = td->mean[ic];
+      xw = td->weight[ic];
+      ic++;
+    } else {
+      xm = td->buf[ib];
+      xw = 1.0;
+      ib++;
+    }
+
+    if (nout > 0 &&
+        (wsofar + td->tweight[nout-1] + xw) / total <= qlimit) {
+      /* Add to the current centroid */
+      td->tweight[nout-1] += xw;
+      td->tmean[nout-1] += (xm - td->tmean[nout-1]) * xw / td->tweight[nout-1];
+    } else {
+      /* Start a new centroid */
+      if (nout > 0) {
+        wsofar += td->tweight[nout-1];
+        qlimit = R_nc_tdigest_qlimit (td, wsofar / total);
+      }
+      td->tmean[nout] = xm;
+      td->tweight[nout] = xw;
+      nout++;
+    }
+  }
+
+  swap = td->mean;
+  td->mean = td->tmean;
+  td->tmean = swap;
+  swap = td->weight;
+  td->weight = td->tweight;
+  td->tweight = swap;
+  td->ncent = nout;
+  td->total = total;
+  td->nbuf = 0;
+}
+
+
+static void
+R_nc_tdigest_add (R_nc_tdigest *td, const double *vv, size_t nv)
+{
+  size_t ii;
+  double xx;
+  for (ii=0; ii<nv; ii++) {
+    xx = vv[ii];
+    if (ISNAN(xx)) {
+      continue;
+    }
+    td->min = (xx < td->min) ? xx : td->min;
+    td->max = (xx > td->max) ? xx : td->max;
+    td->buf[td->nbuf++] = xx;
+    if (td->nbuf == td->maxbuf) {
+      R_nc_tdigest_merge (td);
+    }
+  }
+}
+
+
+/* Estimate quantile q (0 <= q <= 1) from a merged digest,
+   interpolating between centroid means and the extreme values.
+ */
+static double
+R_nc_tdigest_quantile (const R_nc_tdigest *td, double q)
+{
+  size_t ii, nn;
+  double target, cum, dw, half;
+
+  nn = td->ncent;
+  if (nn == 0 || ISNAN(q)) {
+    return NA_REAL;
+  } else if (q <= 0) {
+    return td->min;
+  } else if (q >= 1) {
+    return td->max;
+  } else if (nn == 1) {
+    return td->mean[0];
+  }
+
+  target = q * td->total;
+
+  /* Lower tail between the minimum and the first centroid */
+  half = td->weight[0] / 2;
+  if (target < half) {
+    return td->min + (td->mean[0] - td->min) * target / half;
+  }
+
+  cum = half;
+  for (ii=0; ii<nn-1; ii++) {
+    dw = (td->weight[ii] + td->weight[ii+1]) / 2;
+    if (target < cum + dw) {
+      return td->mean[ii] +
+               (td->mean[ii+1] - td->mean[ii]) * (target - cum) / dw;
+    }
+    cum += dw;
+  }
+
+  /* Upper tail between the last centroid and the maximum */
+  half = td->weight[nn-1] / 2;
+  return td->mean[nn-1] +
+           (td->max - td->mean[nn-1]) * (target - cum) / half;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_quantile_var()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_quantile_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP probs,
+                   SEXP compression, SEXP namode, SEXP unpack)
+{
+  int ncid, varid;
+  size_t ii, nprob;
+  double cmp, *cprobs, *out;
+  R_nc_blocks blk;
+  R_nc_tdigest td;
+  SEXP result, values;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  if (!isReal (probs)) {
+    error ("Probabilities must be double precision");
+  }
+  nprob = xlength (probs);
+  cprobs = REAL (probs);
+
+  cmp = asReal (compression);
+  if (!R_FINITE (cmp) || cmp < 10) {
+    error ("Compression must be at least 10");
+  }
+
+  R_nc_blocks_init (&blk, ncid, varid, start, count,
+                    asInteger (namode), asLogical (unpack) == TRUE);
+  R_nc_tdigest_init (&td, cmp);
+
+  /*-- Add values to the digest block by block --------------------------------*/
+  while (!blk.done) {
+    values = PROTECT(R_nc_blocks_read (&blk));
+    R_nc_tdigest_add (&td, REAL (values), xlength (values));
+    UNPROTECT(1);
+    R_nc_blocks_advance (&blk);
+  }
+  R_nc_tdigest_merge (&td);
+
+  /*-- Estimate quantiles -----------------------------------------------------*/
+  result = PROTECT(allocVector (REALSXP, nprob));
+  out = REAL (result);
+  for (ii=0; ii<nprob; ii++) {
+    out[ii] = R_nc_tdigest_quantile (&td, cprobs[ii]);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*=============================================================================*\
+ *  Filtered reads.
+\*=============================================================================*/
+
+/* Predicates applied by R_nc_filter_var */
+typedef enum {
+  RNC_FILTER_EQ, RNC_FILTER_NE, RNC_FILTER_GT, RNC_FILTER_GE,
+  RNC_FILTER_LT, RNC_FILTER_LE, RNC_FILTER_BETWEEN, RNC_FILTER_VALID
+} R_nc_filter;
+
+
+static R_nc_filter
+R_nc_str2filter (SEXP op)
+{
+  if (R_nc_strcmp (op, "==")) {
+    return RNC_FILTER_EQ;
+  } else if (R_nc_strcmp (op, "!=")) {
+    return RNC_FILTER_NE;
+  } else if (R_nc_strcmp (op, ">")) {
+    return RNC_FILTER_GT;
+  } else if (R_nc_strcmp (op, ">=")) {
+    return RNC_FILTER_GE;
+  } else if (R_nc_strcmp (op, "<")) {
+    return RNC_FILTER_LT;
+  } else if (R_nc_strcmp (op, "<=")) {
+    return RNC_FILTER_LE;
+  } else if (R_nc_strcmp (op, "between")) {
+    return RNC_FILTER_BETWEEN;
+  } else if (R_nc_strcmp (op, "valid")) {
+    return RNC_FILTER_VALID;
+  } else {
+    error ("Unknown filter operator");
+  }
+}
+
+
+/* Set mask[ii] to 1 for values that pass a predicate, 0 otherwise.
+   Missing values never pass. Result is the number of values that pass.
+ */
+static size_t
+R_nc_filter_mask (R_nc_filter op, double lo, double hi,
+                  const double *vv, size_t nv, char *mask)
+{
+  size_t ii, npass;
+  double xx;
+
+  switch (op) {
+  case RNC_FILTER_EQ:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = (vv[ii] == lo);
+    }
+    break;
+  case RNC_FILTER_NE:
+    for (ii=0; ii<nv; ii++) {
+      xx = vv[ii];
+      mask[ii] = (!ISNAN(xx) && xx != lo);
+    }
+    break;
+  case RNC_FILTER_GT:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = (vv[ii] > lo);
+    }
+    break;
+  case RNC_FILTER_GE:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = (vv[ii] >= lo);
+    }
+    break;
+  case RNC_FILTER_LT:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = (vv[ii] < lo);
+    }
+    break;
+  case RNC_FILTER_LE:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = (vv[ii] <= lo);
+    }
+    break;
+  case RNC_FILTER_BETWEEN:
+    for (ii=0; ii<nv; ii++) {
+      xx = vv[ii];
+      mask[ii] = (xx >= lo && xx <= hi);
+    }
+    break;
+  case RNC_FILTER_VALID:
+    for (ii=0; ii<nv; ii++) {
+      mask[ii] = !ISNAN(vv[ii]);
+    }
+    break;
+  }
+
+  npass = 0;
+  for (ii=0; ii<nv; ii++) {
+    npass += mask[ii];
+  }
+  return npass;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_filter_var()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_filter_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP op,
+                 SEXP value, SEXP namode, SEXP unpack)
+{
+  int ncid, varid, ndims, idim;
+  R_nc_filter cop;
+  double lo, hi, *hit, *outval, *outidx;
+  const double *vv, *src;
+  size_t nv, npass, ntotal, nblock, maxblock, ii, jj, kk, *index;
+  char *mask;
+  const void *vmax;
+  R_nc_blocks blk;
+  SEXP result, values, hits, outv, outi;
+  PROTECT_INDEX ihits;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  cop = R_nc_str2filter (op);
+  lo = NA_REAL;
+  hi = NA_REAL;
+  if (cop != RNC_FILTER_VALID) {
+    if (!isReal (value) || xlength (value) < 1 ||
+        (cop == RNC_FILTER_BETWEEN && xlength (value) < 2)) {
+      error ("Missing or invalid value for filter");
+    }
+    lo = REAL (value)[0];
+    if (cop == RNC_FILTER_BETWEEN) {
+      hi = REAL (value)[1];
+    }
+  }
+
+  R_nc_blocks_init (&blk, ncid, varid, start, count,
+                    asInteger (namode), asLogical (unpack) == TRUE);
+  ndims = blk.ndims;
+  index = (size_t *) R_alloc ((ndims > 0) ? ndims : 1, sizeof (size_t));
+
+  /*-- Collect values that pass the filter block by block ---------------------*/
+  /* Each block with any hits contributes a vector of records
+     (value followed by R indices of the value) to list hits */
+  maxblock = 16;
+  nblock = 0;
+  ntotal = 0;
+  PROTECT_WITH_INDEX(hits = allocVector (VECSXP, maxblock), &ihits);
+
+  while (!blk.done) {
+    values = PROTECT(R_nc_blocks_read (&blk));
+    vv = REAL (values);
+    nv = xlength (values);
+
+    vmax = vmaxget ();
+    mask = R_alloc (nv, sizeof (char));
+    npass = R_nc_filter_mask (cop, lo, hi, vv, nv, mask);
+
+    if (npass > 0) {
+      if (nblock == maxblock) {
+        maxblock *= 2;
+        REPROTECT(hits = xlengthgets (hits, maxblock), ihits);
+      }
+      SET_VECTOR_ELT (hits, nblock, allocVector (REALSXP,
+                                                 npass * (ndims + 1)));
+      hit = REAL (VECTOR_ELT (hits, nblock));
+      nblock++;
+      ntotal += npass;
+
+      /* Iterate over elements of the block in C order */
+      for (idim=0; idim<ndims; idim++) {
+        index[idim] = 0;
+      }
+      for (ii=0, jj=0; ii<nv; ii++) {
+        if (mask[ii]) {
+          hit[jj++] = vv[ii];
+          /* Store 1-based indices of the variable in R order */
+          for (idim=ndims-1; idim>=0; idim--) {
+            hit[jj++] = blk.start[idim] + blk.bstart[idim] + index[idim] + 1;
+          }
+        }
+        for (idim=ndims-1; idim>=0; idim--) {
+          if (++index[idim] < blk.bcount[idim]) {
+            break;
+          }
+          index[idim] = 0;
+        }
+      }
+    }
+
+    vmaxset (vmax);
+    UNPROTECT(1);
+    R_nc_blocks_advance (&blk);
+  }
+
+  /*-- Return indices and values in a list ------------------------------------*/
+  outv = PROTECT(allocVector (REALSXP, ntotal));
+  outi = PROTECT(allocMatrix (REALSXP, ntotal, ndims));
+  outval = REAL (outv);
+  outidx = REAL (outi);
+  for (ii=0, kk=0; ii<nblock; ii++) {
+    src = REAL (VECTOR_ELT (hits, ii));
+    npass = xlength (VECTOR_ELT (hits, ii)) / (ndims + 1);
+    for (jj=0; jj<npass; jj++, kk++) {
+      outval[kk] = *src++;
+      for (idim=0; idim<ndims; idim++) {
+        outidx[idim * ntotal + kk] = *src++;
+      }
+    }
+  }
+
+  result = PROTECT(allocVector (VECSXP, 2));
+  SET_VECTOR_ELT (result, 0, outi);
+  SET_VECTOR_ELT (result, 1, outv);
+
+  UNPROTECT(4);
+  return result;
+}
@@ -346,9 +346,17 @@ R_nc_inq_type (SEXP nc, SEXP type, SEXP fields)
 
   /*-- Convert arguments to netcdf ids ----------------------------------------*/
   ncid = asInteger (nc);
-  R_nc_check (R_nc_type_id (type, ncid, &xtype, 0));
   extend = (asLogical (fields) == TRUE);
 
+  R_nc_check (R_nc_type_id (type, ncid, &xtype, 0));
+
+  /*-- Use cached result (if any) ---------------------------------------------*/
+  result = R_nc_cache_get (ncid, extend ? 'f' : 't', xtype, 0);
+  if (result) {
+    return result;
+  }
+  result = R_NilValue;
+
   /*-- General properties -----------------------------------------------------*/
   R_nc_check (nc_inq_type (ncid, xtype, NULL, &size));
   R_nc_check (R_nc_type2str (ncid, xtype, typename));
@@ -498,6 +506,8 @@ R_nc_inq_type (SEXP nc, SEXP type, SEXP fields)
   SET_STRING_ELT (resultnames, 2, mkChar ("class"));
   SET_STRING_ELT (resultnames, 3, mkChar ("size"));
 
+  R_nc_cache_put (ncid, extend ? 'f' : 't', xtype, 0, result);
+
   UNPROTECT(1);
   return result;
 }
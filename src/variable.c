@@ -176,333 +176,376 @@ R_nc_def_var (SEXP nc, SEXP varname, SEXP type, SEXP dims,
 }
 
 
-/*-----------------------------------------------------------------------------*
- *  Private functions used by R_nc_get_var()
- *-----------------------------------------------------------------------------*/
-
-/* Macros to set **max or **min so that **fill is outside valid range */
-#define FILL2RANGE_REAL(TYPE, EPS) { \
-  if (!ISNAN(**(TYPE **) fill)) { \
-    if (**(TYPE **) fill > (TYPE) 0) { \
-      *max = R_alloc (1, sizeof(TYPE)); \
-      **(TYPE **) max = **(TYPE **) fill * ((TYPE) 1 - (TYPE) 2 * (TYPE) EPS); \
-    } else { \
-      *min = R_alloc (1, sizeof(TYPE)); \
-      **(TYPE **) min = **(TYPE **) fill * ((TYPE) 1 + (TYPE) 2 * (TYPE) EPS); \
-    } \
-  } \
-}
-#define FILL2RANGE_INT(TYPE) { \
-  if (**(TYPE **) fill > (TYPE) 0) { \
-    *max = R_alloc (1, sizeof(TYPE)); \
-    **(TYPE **) max = **(TYPE **) fill - (TYPE) 1; \
-  } else { \
-    *min = R_alloc (1, sizeof(TYPE)); \
-    **(TYPE **) min = **(TYPE **) fill + (TYPE) 1; \
-  }; \
+/* Ratio of hash slots to chunks held in an automatically sized chunk cache */
+#define RNC_CHUNK_SLOT_RATIO 10
+
+/* Plan for access to a hyperslab of a chunked variable.
+   Member ntotal is the number of chunks touched by the hyperslab,
+     and chunkbytes is the in-memory size of one chunk.
+ */
+typedef struct {
+  size_t ntotal, chunkbytes;
+} R_nc_chunk_plan;
+
+
+/* Find the smallest prime number that is not less than n.
+ */
+static size_t
+R_nc_next_prime (size_t n)
+{
+  size_t ii;
+  if (n <= 2) {
+    return 2;
+  }
+  if (n % 2 == 0) {
+    n++;
+  }
+  for (;; n += 2) {
+    for (ii = 3; ii * ii <= n; ii += 2) {
+      if (n % ii == 0) {
+        break;
+      }
+    }
+    if (ii * ii > n) {
+      return n;
+    }
+  }
 }
 
-/* Find attributes related to missing values for a netcdf variable.
-   On exit, relevant parameters are returned via double pointers to
-     fill, min and max, which are either NULL or allocated by R_alloc.
-     The function returns the in-memory size (bytes) of a missing value.
-   Argument mode specifies the attributes used for missing values:
-     0 - _FillValue, or missing_value
-     1 - _FillValue only
-     2 - missing_value only
-     3 - none
-     4 - fill value and valid range determined as described at
-         http://www.unidata.ucar.edu/software/netcdf/docs/attribute_conventions.html
-   Example: R_nc_miss_att (ncid, varid, mode, &fill, &min, &max);
-  */
+
+/* Number of chunks of length chunk that intersect the index range
+   [start, start+count).
+ */
 static size_t
-R_nc_miss_att (int ncid, int varid, int mode,
-               void **fill, void **min, void **max)
+R_nc_chunks_touched (size_t start, size_t count, size_t chunk)
 {
-  size_t cnt, size;
-  nc_type atype, xtype;
-  char *range;
-  *fill = NULL;
-  *min = NULL;
-  *max = NULL;
-
-  /* Get details about type and size of netcdf variable */
-  R_nc_check (nc_inq_vartype (ncid, varid, &xtype));
-  if (xtype == NC_CHAR ||
-      xtype == NC_STRING ||
-      xtype > NC_MAX_ATOMIC_TYPE) {
-    /* NetCDF attribute conventions describe the handling of missing values
-       in atomic numeric types. Let users handle other types as needed.
-     */
+  if (count == 0 || chunk == 0) {
     return 0;
   }
-  R_nc_check (nc_inq_type (ncid, xtype, NULL, &size));
+  return (start + count - 1) / chunk - start / chunk + 1;
+}
 
-  if (mode == 0 || mode == 1) {
-    if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
-        cnt == 1 &&
-        atype == xtype) {
-      *fill = R_alloc (1, size);
-      R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
-    }
-  } else if (mode == 0 || mode == 2) {
-    if (nc_inq_att (ncid, varid, "missing_value", &atype, &cnt) == NC_NOERR &&
-        cnt == 1 &&
-        atype == xtype) {
-      *fill = R_alloc (1, size);
-      R_nc_check (nc_get_att (ncid, varid, "missing_value", *fill));
-    }
-  } else if (mode == 3) {
-    /* Let user code handle missing values */
+
+/* Plan access to a hyperslab (start, count in C order) of a netcdf variable.
+   Returns 1 if the variable is chunked (and plan is set), 0 otherwise
+   (including when the netcdf library does not support chunking).
+ */
+static int
+R_nc_plan_chunks (int ncid, int varid, nc_type xtype, int ndims,
+                  const size_t *start, const size_t *count,
+                  R_nc_chunk_plan *plan)
+{
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  int storeprop, idim;
+  size_t *chunksize;
+#endif
+
+  plan->ntotal = 0;
+  plan->chunkbytes = 0;
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  if (ndims <= 0 ||
+      nc_inq_var_chunking (ncid, varid, &storeprop, NULL) != NC_NOERR ||
+      storeprop != NC_CHUNKED) {
     return 0;
+  }
 
-  } else if (mode == 4) {
-
-    /* Special rules apply to byte data */
-    if ((xtype == NC_BYTE) || (xtype == NC_UBYTE)) {
-
-      /* For byte data, valid_range, valid_min and valid_max attributes
-       * may differ from the type of variable, so we read the attributes
-       * with routines that convert to the expected type.
-       */
-      if (nc_inq_att (ncid, varid, "valid_min", &atype, &cnt) == NC_NOERR &&
-          cnt == 1) {
-        *min = R_alloc (1, 1);
-        if (xtype == NC_UBYTE) {
-          R_nc_check (nc_get_att_uchar (ncid, varid, "valid_min", *min));
-        } else {
-          R_nc_check (nc_get_att_schar (ncid, varid, "valid_min", *min));
-        }
-      }
-      if (nc_inq_att (ncid, varid, "valid_max", &atype, &cnt) == NC_NOERR &&
-          cnt == 1) {
-        *max = R_alloc (1, 1);
-        if (xtype == NC_UBYTE) {
-          R_nc_check (nc_get_att_uchar (ncid, varid, "valid_max", *max));
-        } else {
-          R_nc_check (nc_get_att_schar (ncid, varid, "valid_max", *max));
-        }
-      }
-      if (!*min && !*max &&
-          nc_inq_att (ncid, varid, "valid_range", &atype, &cnt) == NC_NOERR &&
-          cnt == 2) {
-        range = R_alloc (2, 1);
-        *min = range;
-        *max = range + 1;
-        if (xtype == NC_UBYTE) {
-          R_nc_check (nc_get_att_uchar (
-                        ncid, varid, "valid_range", (unsigned char *) range));
-        } else {
-          R_nc_check (nc_get_att_schar (
-                        ncid, varid, "valid_range", (signed char *) range));
-        }
-      }
+  chunksize = (size_t *) R_alloc (ndims, sizeof (size_t));
+  R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, chunksize));
+  R_nc_check (nc_inq_type (ncid, xtype, NULL, &(plan->chunkbytes)));
 
-      /* Only set fill value if explicitly defined.
-       * _FillValue attribute should have same type as variable.
-       */
-      if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
-          cnt == 1 &&
-          atype == xtype) {
-        *fill = R_alloc (1, 1);
-        R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
-      }
+  /* Count chunks touched by the hyperslab */
+  plan->ntotal = 1;
+  for (idim=0; idim<ndims; idim++) {
+    plan->chunkbytes *= chunksize[idim];
+    plan->ntotal *= R_nc_chunks_touched (start[idim], count[idim],
+                                         chunksize[idim]);
+  }
 
-      /* If _FillValue is defined without a valid range,
-       * set the valid range to exclude _FillValue
-       */
-      if (*fill && !*max && !*min) {
-        if (xtype == NC_UBYTE) {
-          FILL2RANGE_INT(unsigned char)
-        } else {
-          FILL2RANGE_INT(signed char)
-        }
-      }
+  return 1;
+#else
+  return 0;
+#endif
+}
 
-      /* If a valid range is defined without a fill value,
-       * use the default fill value if it is outside the valid range
-       */
-      if (!*fill && *max) {
-        if (xtype == NC_UBYTE) {
-          if (NC_FILL_UBYTE > **(unsigned char **) max) {
-            *fill = R_alloc(1, 1);
-            **(unsigned char **) fill = NC_FILL_UBYTE;
-          }
-        } else {
-          if (NC_FILL_BYTE > **(signed char **) max) {
-            *fill = R_alloc(1, 1);
-            **(signed char **) fill = NC_FILL_BYTE;
-          }
-        }
-      }
 
-      if (!*fill && *min) {
-        if (xtype == NC_UBYTE) {
-          if (NC_FILL_UBYTE < **(unsigned char **) min) {
-            *fill = R_alloc(1, 1);
-            **(unsigned char **) fill = NC_FILL_UBYTE;
-          }
-        } else {
-          if (NC_FILL_BYTE < **(signed char **) min) {
-            *fill = R_alloc(1, 1);
-            **(signed char **) fill = NC_FILL_BYTE;
-          }
-        }
-      }
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
 
-    } else {
-      /* All types other than byte data */
-
-      /* Type of valid_* attribute must match type of variable data */
-      if (nc_inq_att (ncid, varid, "valid_min", &atype, &cnt) == NC_NOERR &&
-          cnt == 1 &&
-          atype == xtype) {
-        *min = R_alloc (1, size);
-        R_nc_check (nc_get_att (ncid, varid, "valid_min", *min));
-      }
-      if (nc_inq_att (ncid, varid, "valid_max", &atype, &cnt) == NC_NOERR &&
-          cnt == 1 &&
-          atype == xtype) {
-        *max = R_alloc (1, size);
-        R_nc_check (nc_get_att (ncid, varid, "valid_max", *max));
-      }
-      if (!*min && !*max &&
-          nc_inq_att (ncid, varid, "valid_range", &atype, &cnt) == NC_NOERR &&
-          cnt == 2 &&
-          atype == xtype) {
-        range = R_alloc (2, size);
-        *min = range;
-        *max = range + size;
-        R_nc_check (nc_get_att (ncid, varid, "valid_range", range));
-      }
+/* Chunk cache settings of a variable before access,
+   and a flag to indicate that they must be restored afterwards.
+ */
+typedef struct {
+  int ncid, varid, restore;
+  size_t bytes, slots;
+  float preemption;
+} R_nc_chunk_cache;
 
-      /* Get fill value from attribute or use default */
-      if (nc_inq_att (ncid, varid, "_FillValue", &atype, &cnt) == NC_NOERR &&
-          cnt == 1 &&
-          atype == xtype) {
-        *fill = R_alloc (1, size);
-        R_nc_check (nc_get_att (ncid, varid, "_FillValue", *fill));
-      } else {
-        *fill = R_alloc (1, size);
-        switch (xtype) {
-          case NC_SHORT:
-            **(short **) fill = NC_FILL_SHORT;
-            break;
-          case NC_USHORT:
-            **(unsigned short **) fill = NC_FILL_USHORT;
-            break;
-          case NC_INT:
-            **(int **) fill = NC_FILL_INT;
-            break;
-          case NC_UINT:
-            **(unsigned int **) fill = NC_FILL_UINT;
-            break;
-          case NC_FLOAT:
-            **(float **) fill = NC_FILL_FLOAT;
-            break;
-          case NC_DOUBLE:
-            **(double **) fill = NC_FILL_DOUBLE;
-            break;
-          case NC_INT64:
-            **(long long **) fill = NC_FILL_INT64;
-            break;
-          case NC_UINT64:
-            **(unsigned long long **) fill = NC_FILL_UINT64;
-            break;
-          default:
-            error ("Default fill value not implemented");
-        }
-      }
 
-      /* If _FillValue is defined without a valid range,
-       * set the valid range to exclude _FillValue
-       */
-      if (*fill && !*max && !*min) {
-        switch (xtype) {
-          case NC_SHORT:
-            FILL2RANGE_INT(short);
-            break;
-          case NC_USHORT:
-            FILL2RANGE_INT(unsigned short);
-            break;
-          case NC_INT:
-            FILL2RANGE_INT(int);
-            break;
-          case NC_UINT:
-            FILL2RANGE_INT(unsigned int);
-            break;
-          case NC_INT64:
-            FILL2RANGE_INT(long long);
-            break;
-          case NC_UINT64:
-            FILL2RANGE_INT(unsigned long long);
-            break;
-          case NC_FLOAT:
-            FILL2RANGE_REAL(float, FLT_EPSILON);
-            break;
-          case NC_DOUBLE:
-            FILL2RANGE_REAL(double, DBL_EPSILON);
-            break;
-          default:
-            error ("Default valid range not implemented");
-        }
-      }
+/* Save the chunk cache settings of a variable in cache,
+   without requiring them to be restored.
+ */
+static void
+R_nc_cache_save (int ncid, int varid, R_nc_chunk_cache *cache)
+{
+  cache->ncid = ncid;
+  cache->varid = varid;
+  cache->restore = 0;
+  R_nc_check (nc_get_var_chunk_cache(ncid, varid, &(cache->bytes),
+                                     &(cache->slots), &(cache->preemption)));
+}
 
-    }
-  } else {
-    error ("Unknown mode for handling missing values");
 
+/* Size the chunk cache of a variable before access to hold nchunks chunks
+   of chunkbytes bytes (up to RNC_MAXBYTES bytes) with a prime number of
+   hash slots, unless the cache is already large enough. Finite values of
+   slots_in and preempt_in replace the computed settings. The previous
+   settings are saved for R_nc_cache_restore.
+ */
+static void
+R_nc_cache_fit (int ncid, int varid, size_t nchunks, size_t chunkbytes,
+                double slots_in, double preempt_in, R_nc_chunk_cache *cache)
+{
+  size_t bytes, slots, workbytes;
+  float preemption;
+
+  R_nc_cache_save (ncid, varid, cache);
+  bytes = cache->bytes;
+  slots = cache->slots;
+  preemption = cache->preemption;
+
+  workbytes = nchunks * chunkbytes;
+  if (workbytes > RNC_MAXBYTES) {
+    workbytes = RNC_MAXBYTES;
+  }
+  if (workbytes > bytes) {
+    bytes = workbytes;
+  }
+  if (R_FINITE(slots_in)) {
+    slots = slots_in;
+  } else if (slots < RNC_CHUNK_SLOT_RATIO * nchunks) {
+    slots = R_nc_next_prime (RNC_CHUNK_SLOT_RATIO * nchunks);
+  }
+  if (R_FINITE(preempt_in)) {
+    preemption = preempt_in;
+  }
+  if (bytes != cache->bytes || slots != cache->slots ||
+      preemption != cache->preemption) {
+    R_nc_check (nc_set_var_chunk_cache(ncid, varid,
+                                       bytes, slots, preemption));
+    cache->restore = 1;
   }
-  return size;
 }
 
 
-/* Find packing attributes for a given netcdf variable.
-   On entry, pointers for results are passed from caller.
-   On exit, either values are set or pointers are NULLed.
-   Example: R_nc_pack_att (ncid, varid, scalep, addp);
-  */
+/* Apply chunk cache options to a chunked variable before access.
+   If cache_bytes is "auto", the cache is sized by R_nc_cache_fit.
+   Otherwise, finite values of the cache arguments are applied to the
+     variable and remain in effect after access.
+   If no cache arguments are given and grow is true, the cache is enlarged
+     (if needed) to hold nchunks chunks during access, and the previous
+     settings are saved for R_nc_cache_restore.
+ */
 static void
-R_nc_pack_att (int ncid, int varid, double **scale, double **add)
+R_nc_cache_set (int ncid, int varid, size_t nchunks, size_t chunkbytes,
+                SEXP cache_bytes, SEXP cache_slots, SEXP cache_preemption,
+                int grow, R_nc_chunk_cache *cache)
 {
-  size_t cnt;
-  if (nc_inq_attlen (ncid, varid, "scale_factor", &cnt) != NC_NOERR ||
-        cnt != 1 ||
-        nc_get_att_double (ncid, varid, "scale_factor", *scale) != NC_NOERR ) {
-    *scale = NULL;
+  size_t bytes, slots, workbytes;
+  float preemption;
+  double bytes_in, slots_in, preempt_in;
+
+  slots_in = asReal (cache_slots);
+  preempt_in = asReal (cache_preemption);
+
+  if (isString (cache_bytes) && R_nc_strcmp (cache_bytes, "auto")) {
+    R_nc_cache_fit (ncid, varid, nchunks, chunkbytes,
+                    slots_in, preempt_in, cache);
+    return;
+  }
+  bytes_in = asReal (cache_bytes);
+
+  R_nc_cache_save (ncid, varid, cache);
+  bytes = cache->bytes;
+  slots = cache->slots;
+  preemption = cache->preemption;
+
+  workbytes = nchunks * chunkbytes;
+  if (workbytes > RNC_MAXBYTES) {
+    workbytes = RNC_MAXBYTES;
+  }
+
+  if (R_FINITE(bytes_in) || R_FINITE(slots_in) || R_FINITE(preempt_in)) {
+    if (R_FINITE(bytes_in)) {
+      bytes = bytes_in;
+    }
+    if (R_FINITE(slots_in)) {
+      slots = slots_in;
+    }
+    if (R_FINITE(preempt_in)) {
+      preemption = preempt_in;
+    }
+    R_nc_check (nc_set_var_chunk_cache(ncid, varid,
+                                       bytes, slots, preemption));
+
+  } else if (grow && nchunks * chunkbytes <= RNC_MAXBYTES &&
+             workbytes > bytes) {
+    /* Enlarge the cache to hold the chunks touched by the access */
+    bytes = workbytes;
+    if (slots < RNC_CHUNK_SLOT_RATIO * nchunks) {
+      slots = R_nc_next_prime (RNC_CHUNK_SLOT_RATIO * nchunks);
+    }
+    R_nc_check (nc_set_var_chunk_cache(ncid, varid,
+                                       bytes, slots, preemption));
+    cache->restore = 1;
   }
-  if (nc_inq_attlen (ncid, varid, "add_offset", &cnt) != NC_NOERR ||
-    cnt != 1 ||
-    nc_get_att_double (ncid, varid, "add_offset", *add) != NC_NOERR ) {
-    *add = NULL;
+}
+
+
+/* Restore chunk cache settings saved by R_nc_cache_set (if required).
+   Result is a netcdf status value.
+ */
+static int
+R_nc_cache_restore (R_nc_chunk_cache *cache)
+{
+  if (cache->restore) {
+    cache->restore = 0;
+    return nc_set_var_chunk_cache(cache->ncid, cache->varid, cache->bytes,
+                                  cache->slots, cache->preemption);
   }
+  return NC_NOERR;
 }
 
+#endif
+
 
 /*-----------------------------------------------------------------------------*\
  *  R_nc_get_var()
 \*-----------------------------------------------------------------------------*/
 
+/* Convert start or count from R to C order as double values (1-based),
+   where a single NA (or NaN) is expanded to NA for all dimensions.
+   Elements beyond ndims are ignored.
+ */
+static double *
+R_nc_index_r2c (SEXP rv, int ndims, const char *name)
+{
+  SEXP rdbl;
+  double *cv;
+  R_xlen_t nr;
+  int ii;
+
+  rdbl = PROTECT (coerceVector (rv, REALSXP));
+  nr = xlength (rdbl);
+  cv = (double *) R_alloc (ndims > 0 ? ndims : 1, sizeof (double));
+  if (nr == 1 && ISNAN (REAL (rdbl)[0])) {
+    for (ii=0; ii<ndims; ii++) {
+      cv[ii] = NA_REAL;
+    }
+  } else if (nr < ndims) {
+    error ("Length of %s must equal number of dimensions", name);
+  } else {
+    for (ii=0; ii<ndims; ii++) {
+      cv[ndims-1-ii] = REAL (rdbl)[ii];
+    }
+  }
+  UNPROTECT (1);
+  return cv;
+}
+
+
+/* Find the current lengths of all dimensions of a variable in C order,
+   after writing appended records that are due.
+   Result is a netcdf status value.
+ */
+static int
+R_nc_var_dimlen (int ncid, int varid, int ndims, size_t *dimlen)
+{
+  int status, ii, *dimids;
+
+  if (ndims <= 0) {
+    return NC_NOERR;
+  }
+  status = R_nc_append_expire (ncid);
+  if (status != NC_NOERR) {
+    return status;
+  }
+  dimids = (int *) R_alloc (ndims, sizeof (int));
+  status = nc_inq_vardimid (ncid, varid, dimids);
+  for (ii=0; ii<ndims && status == NC_NOERR; ii++) {
+    status = nc_inq_dimlen (ncid, dimids[ii], &dimlen[ii]);
+  }
+  return status;
+}
+
+
+/* Find the C start and count of a read from variable varid,
+   where missing start defaults to 1 and missing count extends
+   to the end of each dimension, as described in the man page of var.get.nc.
+   Results are allocated by R_alloc (or NULL for scalar variables).
+ */
+static void
+R_nc_get_region (int ncid, int varid, int ndims, SEXP start, SEXP count,
+                 size_t **cstart, size_t **ccount)
+{
+  double *rstart, *rcount;
+  size_t *dimlen=NULL;
+  int ii;
+
+  *cstart = NULL;
+  *ccount = NULL;
+  if (ndims <= 0) {
+    return;
+  }
+
+  rstart = R_nc_index_r2c (start, ndims, "start");
+  rcount = R_nc_index_r2c (count, ndims, "count");
+  *cstart = (size_t *) R_alloc (ndims, sizeof (size_t));
+  *ccount = (size_t *) R_alloc (ndims, sizeof (size_t));
+
+  for (ii=0; ii<ndims; ii++) {
+    if (ISNAN (rstart[ii])) {
+      rstart[ii] = 1;
+    } else if (rstart[ii] < 1) {
+      error ("Elements of start must be at least 1");
+    }
+    (*cstart)[ii] = rstart[ii] - 1;
+
+    if (ISNAN (rcount[ii])) {
+      if (!dimlen) {
+        dimlen = (size_t *) R_alloc (ndims, sizeof (size_t));
+        R_nc_check (R_nc_var_dimlen (ncid, varid, ndims, dimlen));
+      }
+      (*ccount)[ii] = (dimlen[ii] > (*cstart)[ii]) ?
+                      dimlen[ii] - (*cstart)[ii] : 0;
+    } else if (rcount[ii] < 0) {
+      error ("Elements of count must not be negative");
+    } else {
+      (*ccount)[ii] = rcount[ii];
+    }
+  }
+}
+
+
 SEXP
 R_nc_get_var (SEXP nc, SEXP var, SEXP start, SEXP count,
               SEXP rawchar, SEXP fitnum, SEXP namode, SEXP unpack,
               SEXP cache_bytes, SEXP cache_slots, SEXP cache_preemption)
 {
-  int ncid, varid, ndims, ii, israw, isfit, inamode, isunpack;
+  int ncid, varid, ndims, israw, isfit, inamode, isunpack, ischunked;
+  int status=NC_NOERR;
   size_t *cstart=NULL, *ccount=NULL;
   nc_type xtype;
   SEXP result=R_NilValue;
   void *buf;
   R_nc_buf io;
+  R_nc_chunk_plan plan;
   double add, scale, *addp=NULL, *scalep=NULL;
   void *fillp=NULL, *minp=NULL, *maxp=NULL;
   size_t fillsize;
 
 #ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-  int storeprop;
-  size_t bytes, slots;
-  float preemption;
-  double bytes_in, slots_in, preempt_in;
+  R_nc_chunk_cache cache;
+  int cachestat;
 #endif
 
   /*-- Convert arguments ------------------------------------------------------*/
@@ -515,42 +558,18 @@ R_nc_get_var (SEXP nc, SEXP var, SEXP start, SEXP count,
   inamode = asInteger (namode);
   isunpack = (asLogical (unpack) == TRUE);
 
-  /*-- Chunk cache options for netcdf4 files ----------------------------------*/
-#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-  R_nc_check (nc_inq_var_chunking (ncid, varid, &storeprop, NULL));
-  if (storeprop == NC_CHUNKED) {
-    R_nc_check (nc_get_var_chunk_cache(ncid, varid,
-                                       &bytes, &slots, &preemption));
-    bytes_in = asReal (cache_bytes);
-    slots_in = asReal (cache_slots);
-    preempt_in = asReal (cache_preemption);
-    if (R_FINITE(bytes_in) || R_FINITE(slots_in) || R_FINITE(preempt_in)) {
-      if (R_FINITE(bytes_in)) {
-	bytes = bytes_in;
-      }
-      if (R_FINITE(slots_in)) {
-	slots = slots_in;
-      }
-      if (R_FINITE(preempt_in)) {
-	preemption = preempt_in;
-      }
-      R_nc_check (nc_set_var_chunk_cache(ncid, varid,
-                                         bytes, slots, preemption));
-    }
-  }
-#endif
-
   /*-- Get type and rank of the variable --------------------------------------*/
   R_nc_check (nc_inq_var (ncid, varid, NULL, &xtype, &ndims, NULL, NULL));
 
+  /*-- Write appended records that are due, which may extend dimensions -------*/
+  R_nc_check (R_nc_append_expire (ncid));
+
   /*-- Convert start and count from R to C indices ----------------------------*/
-  if (ndims > 0) {
-    cstart = R_nc_dim_r2c_size (start, ndims, 0);
-    ccount = R_nc_dim_r2c_size (count, ndims, 0);
-    for (ii=0; ii<ndims; ii++) {
-      cstart[ii] -= 1;
-    }
-  }
+  R_nc_get_region (ncid, varid, ndims, start, count, &cstart, &ccount);
+
+  /*-- Count chunks touched by the read for netcdf4 files ---------------------*/
+  ischunked = R_nc_plan_chunks (ncid, varid, xtype, ndims,
+                                cstart, ccount, &plan);
 
   /*-- Get fill attributes (if any) -------------------------------------------*/
   fillsize = R_nc_miss_att (ncid, varid, inamode, &fillp, &minp, &maxp);
@@ -570,9 +589,29 @@ R_nc_get_var (SEXP nc, SEXP var, SEXP start, SEXP count,
   result = PROTECT(R_nc_c2r_init (&io, &buf, ncid, xtype, ndims, ccount,
                      israw, isfit, fillsize, fillp, minp, maxp, scalep, addp));
 
+  /*-- Chunk cache options for netcdf4 files ----------------------------------*/
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  if (ischunked) {
+    R_nc_cache_set (ncid, varid, plan.ntotal, plan.chunkbytes, cache_bytes,
+                    cache_slots, cache_preemption, 1, &cache);
+  }
+#endif
+
   if (R_nc_length (ndims, ccount) > 0) {
-    R_nc_check (nc_get_vara (ncid, varid, cstart, ccount, buf));
+    status = nc_get_vara (ncid, varid, cstart, ccount, buf);
   }
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  /* Restore cache settings before reporting any read error */
+  if (ischunked) {
+    cachestat = R_nc_cache_restore (&cache);
+    if (status == NC_NOERR) {
+      status = cachestat;
+    }
+  }
+#endif
+  R_nc_check (status);
+
   R_nc_c2r (&io);
 
   UNPROTECT(1);
@@ -581,102 +620,372 @@ R_nc_get_var (SEXP nc, SEXP var, SEXP start, SEXP count,
 
 
 /*-----------------------------------------------------------------------------*\
- *  R_nc_inq_var()
+ *  R_nc_iter_var(), R_nc_iter_next()
 \*-----------------------------------------------------------------------------*/
 
+/* State of an iterator over slices of a variable along one dimension.
+   Slices are read from the file in batches of up to nahead slices,
+   which are held in buf until they are returned by R_nc_iter_next.
+   If align is non-zero, batches end on multiples of align (chunk length).
+   Fill values and packing attributes are read when the iterator is created.
+   All dimension-related members are in C order.
+ */
+typedef struct {
+  int ncid, varid, ndims, dim;
+  int israw, isfit;
+  nc_type xtype;
+  size_t *start, *count;
+  size_t nahead, align, pos, bufpos, buflen, outer, inner;
+  size_t fillsize;
+  void *fill, *min, *max;
+  double scale, add, *scalep, *addp;
+  char *buf;
+} R_nc_iter;
+
+
+/* Copy size bytes from src (if not NULL) to memory allocated by R_Calloc */
+static void *
+R_nc_iter_copy (const void *src, size_t size)
+{
+  void *dst=NULL;
+  if (src) {
+    dst = R_Calloc (size, char);
+    memcpy (dst, src, size);
+  }
+  return dst;
+}
+
+
+/* Release memory held by an iterator. */
+static void
+R_nc_iter_free (SEXP ptr)
+{
+  R_nc_iter *iter;
+  iter = R_ExternalPtrAddr (ptr);
+  if (iter) {
+    R_Free (iter->start);
+    R_Free (iter->count);
+    if (iter->fill) {
+      R_Free (iter->fill);
+    }
+    if (iter->min) {
+      R_Free (iter->min);
+    }
+    if (iter->max) {
+      R_Free (iter->max);
+    }
+    if (iter->buf) {
+      R_Free (iter->buf);
+    }
+    R_Free (iter);
+    R_ClearExternalPtr (ptr);
+  }
+}
+
+
 SEXP
-R_nc_inq_var (SEXP nc, SEXP var)
+R_nc_iter_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP along,
+               SEXP prefetch, SEXP rawchar, SEXP fitnum, SEXP namode,
+               SEXP unpack)
 {
-  int ncid, varid, idim, ndims, natts, *dimids, storeprop, format, withnc4;
-  int shuffle, deflate, deflate_level, fletcher;
-  int status;
-  size_t *chunksize_t;
-  double *chunkdbl;
-  char varname[NC_MAX_NAME + 1], vartype[NC_MAX_NAME+1];
+  int ncid, varid, ndims, ii, dim;
+  size_t *cstart, *ccount, *chunksize, elsize, nahead, align=0, slicebytes;
+  size_t fillsize;
+  double prefetch_in;
+  void *fillp, *minp, *maxp;
   nc_type xtype;
-  SEXP result, rdimids, rchunks;
-
-#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-  size_t cache_bytes, cache_slots;
-  float cache_preemption;
-#endif
-#ifdef HAVE_NC_INQ_VAR_ENDIAN
-  int endian;
-#endif
-#ifdef HAVE_NC_INQ_VAR_SZIP
-  int szip_options, szip_bits;
-#endif
-#ifdef HAVE_NC_INQ_VAR_FILTER
-  int filter_id;
-  size_t filter_nparams;
-  SEXP rfilter_params;
-#endif
+  R_nc_chunk_plan plan;
+  R_nc_iter *iter;
+  SEXP result;
 
-  /*-- Convert arguments to netcdf ids ----------------------------------------*/
+  /*-- Convert arguments ------------------------------------------------------*/
   ncid = asInteger (nc);
 
   R_nc_check (R_nc_var_id (var, ncid, &varid));
 
-  /*-- Inquire the variable ---------------------------------------------------*/
-  R_nc_check (nc_inq_format (ncid, &format));
-  withnc4 = (format == NC_FORMAT_NETCDF4);
+  R_nc_check (nc_inq_var (ncid, varid, NULL, &xtype, &ndims, NULL, NULL));
+  if (ndims < 1) {
+    error ("Cannot iterate over a scalar variable");
+  }
 
-  R_nc_check (nc_inq_var (ncid, varid, varname, &xtype, &ndims, NULL, &natts));
+  dim = ndims - asInteger (along);
+  if (dim < 0 || dim >= ndims) {
+    error ("Invalid dimension for iteration");
+  }
 
-  R_nc_check (R_nc_type2str (ncid, xtype, vartype));
+  cstart = R_nc_dim_r2c_size (start, ndims, 0);
+  ccount = R_nc_dim_r2c_size (count, ndims, 0);
+  for (ii=0; ii<ndims; ii++) {
+    cstart[ii] -= 1;
+  }
 
-  if (withnc4) {
-    result = PROTECT(allocVector (VECSXP, 18));
+  /*-- Choose the number of slices read by each access to the file ------------*/
+  prefetch_in = asReal (prefetch);
+  if (xtype == NC_STRING || xtype > NC_MAX_ATOMIC_TYPE) {
+    /* Slices of these types contain pointers to memory allocated by netcdf,
+       which are only freed when slices are converted to R */
+    nahead = 1;
+  } else if (R_FINITE (prefetch_in)) {
+    nahead = (prefetch_in >= 1) ? prefetch_in : 1;
+  } else if (R_nc_plan_chunks (ncid, varid, xtype, ndims,
+                               cstart, ccount, &plan)) {
+    /* Read whole chunks along the dimension of iteration */
+    chunksize = (size_t *) R_alloc (ndims, sizeof (size_t));
+    R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, chunksize));
+    nahead = chunksize[dim];
+    align = nahead;
   } else {
-    result = PROTECT(allocVector (VECSXP, 6));
+    nahead = 1;
   }
 
-  SET_VECTOR_ELT (result, 0, ScalarInteger (varid));
-  SET_VECTOR_ELT (result, 1, mkString (varname));
-  SET_VECTOR_ELT (result, 2, mkString (vartype));
-  SET_VECTOR_ELT (result, 3, ScalarInteger (ndims));
-  SET_VECTOR_ELT (result, 5, ScalarInteger (natts));
+  R_nc_check (nc_inq_type (ncid, xtype, NULL, &elsize));
+  slicebytes = R_nc_length (ndims, ccount) / (ccount[dim] ? ccount[dim] : 1)
+                 * elsize;
+  if (slicebytes > 0 && nahead * slicebytes > RNC_MAXBYTES) {
+    nahead = RNC_MAXBYTES / slicebytes;
+    align = 0;
+  }
+  if (nahead > ccount[dim]) {
+    nahead = ccount[dim];
+  }
+  if (nahead < 1) {
+    nahead = 1;
+  }
 
-  if (ndims > 0) {
-    rdimids = PROTECT(allocVector (INTSXP, ndims));
-    SET_VECTOR_ELT (result, 4, rdimids);
-    UNPROTECT(1);
-    dimids = INTEGER (rdimids);
-    R_nc_check (nc_inq_vardimid (ncid, varid, dimids));
-    /* Return dimension ids in reverse (Fortran) order */
-    R_nc_rev_int (dimids, ndims);
-  } else {
-    /* Return single NA for scalar dimensions */
-    SET_VECTOR_ELT (result, 4, ScalarInteger (NA_INTEGER));
+  /*-- Initialise iterator state ----------------------------------------------*/
+  iter = R_Calloc (1, R_nc_iter);
+  iter->ncid = ncid;
+  iter->varid = varid;
+  iter->ndims = ndims;
+  iter->dim = dim;
+  iter->israw = (asLogical (rawchar) == TRUE);
+  iter->isfit = (asLogical (fitnum) == TRUE);
+  iter->xtype = xtype;
+  iter->start = R_Calloc (ndims, size_t);
+  iter->count = R_Calloc (ndims, size_t);
+  memcpy (iter->start, cstart, ndims * sizeof (size_t));
+  memcpy (iter->count, ccount, ndims * sizeof (size_t));
+  iter->nahead = nahead;
+  iter->align = align;
+  iter->pos = 0;
+  iter->bufpos = 0;
+  iter->buflen = 0;
+  iter->outer = 1;
+  for (ii=0; ii<dim; ii++) {
+    iter->outer *= ccount[ii];
+  }
+  iter->inner = elsize;
+  for (ii=dim+1; ii<ndims; ii++) {
+    iter->inner *= ccount[ii];
   }
+  iter->buf = NULL;
 
-  if (withnc4) {
-    R_nc_check (nc_inq_var_chunking (ncid, varid, &storeprop, NULL));
+  /*-- Keep the dataset handle alive while the iterator exists ----------------*/
+  result = PROTECT(R_MakeExternalPtr (iter, R_NilValue, nc));
+  R_RegisterCFinalizerEx (result, &R_nc_iter_free, TRUE);
 
-    if (storeprop == NC_CHUNKED) {
-      rchunks = PROTECT(allocVector (REALSXP, ndims));
-      SET_VECTOR_ELT (result, 6, rchunks);
-      UNPROTECT(1);
-      chunkdbl = REAL (rchunks);
-      chunksize_t = (size_t *) R_alloc (ndims, sizeof(size_t));
-      R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, chunksize_t));
-      /* Return chunk sizes as double precision in reverse (Fortran) order */
+  if (nahead > 1 && slicebytes > 0) {
+    iter->buf = R_Calloc (nahead * slicebytes, char);
+  }
+
+  /*-- Get fill and packing attributes (if any) once for all slices -----------*/
+  fillsize = R_nc_miss_att (ncid, varid, asInteger (namode),
+                            &fillp, &minp, &maxp);
+  iter->fillsize = fillsize;
+  iter->fill = R_nc_iter_copy (fillp, fillsize);
+  iter->min = R_nc_iter_copy (minp, fillsize);
+  iter->max = R_nc_iter_copy (maxp, fillsize);
+
+  if (asLogical (unpack) == TRUE) {
+    iter->scalep = &(iter->scale);
+    iter->addp = &(iter->add);
+    R_nc_pack_att (ncid, varid, &(iter->scalep), &(iter->addp));
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+SEXP
+R_nc_iter_next (SEXP ptr)
+{
+  R_nc_iter *iter;
+  size_t *sstart, *scount, ii, islice;
+  SEXP result;
+  void *cbuf;
+  R_nc_buf io;
+  int ndims, dim, *fileid=NULL;
+  SEXP handle;
+
+  if (TYPEOF (ptr) != EXTPTRSXP) {
+    error ("Not a valid NetCDF iterator");
+  }
+  iter = R_ExternalPtrAddr (ptr);
+  if (!iter) {
+    error ("NetCDF iterator has been released");
+  }
+
+  /*-- Check that the dataset has not been closed -----------------------------*/
+  /* Groups share the handle of the root group, so compare dataset ids */
+  handle = getAttrib (R_ExternalPtrProtected (ptr), install ("handle_ptr"));
+  if (TYPEOF (handle) == EXTPTRSXP) {
+    fileid = R_ExternalPtrAddr (handle);
+  }
+  if (!fileid || RNC_DATASET_ID (*fileid) != RNC_DATASET_ID (iter->ncid)) {
+    error ("NetCDF dataset of iterator has been closed");
+  }
+
+  ndims = iter->ndims;
+  dim = iter->dim;
+  if (iter->pos >= iter->count[dim]) {
+    return R_NilValue;
+  }
+
+  /*-- Enter data mode and write appended records that are due ----------------*/
+  R_nc_check (R_nc_enddef (iter->ncid));
+  R_nc_check (R_nc_append_expire (iter->ncid));
+
+  /*-- Allocate memory for the next slice -------------------------------------*/
+  sstart = (size_t *) R_alloc (ndims, sizeof (size_t));
+  scount = (size_t *) R_alloc (ndims, sizeof (size_t));
+  memcpy (sstart, iter->start, ndims * sizeof (size_t));
+  memcpy (scount, iter->count, ndims * sizeof (size_t));
+  scount[dim] = 1;
+
+  cbuf = NULL;
+  result = PROTECT(R_nc_c2r_init (&io, &cbuf, iter->ncid, iter->xtype,
+                     ndims, scount, iter->israw, iter->isfit,
+                     iter->fillsize, iter->fill, iter->min, iter->max,
+                     iter->scalep, iter->addp));
+
+  if (R_nc_length (ndims, scount) > 0) {
+    if (!iter->buf) {
+      /*-- Read the slice directly --------------------------------------------*/
+      sstart[dim] += iter->pos;
+      R_nc_check (nc_get_vara (iter->ncid, iter->varid, sstart, scount, cbuf));
+
+    } else {
+      /*-- Read the next batch of slices (if needed) --------------------------*/
+      if (iter->pos < iter->bufpos ||
+          iter->pos >= iter->bufpos + iter->buflen) {
+        iter->bufpos = iter->pos;
+        iter->buflen = iter->count[dim] - iter->pos;
+        if (iter->buflen > iter->nahead) {
+          iter->buflen = iter->nahead;
+        }
+        if (iter->align > 0) {
+          islice = iter->align - (sstart[dim] + iter->pos) % iter->align;
+          if (iter->buflen > islice) {
+            iter->buflen = islice;
+          }
+        }
+        sstart[dim] += iter->bufpos;
+        scount[dim] = iter->buflen;
+        R_nc_check (nc_get_vara (iter->ncid, iter->varid,
+                                 sstart, scount, iter->buf));
+      }
+
+      /*-- Copy the slice from the batch --------------------------------------*/
+      islice = iter->pos - iter->bufpos;
+      for (ii=0; ii<iter->outer; ii++) {
+        memcpy ((char *) cbuf + ii * iter->inner,
+                iter->buf + (ii * iter->buflen + islice) * iter->inner,
+                iter->inner);
+      }
+    }
+  }
+
+  iter->pos++;
+  R_nc_c2r (&io);
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_var()
+\*-----------------------------------------------------------------------------*/
+
+/* Inquire about the properties of a variable that are fixed in data mode.
+   Chunk cache settings of a chunked variable in a netcdf4 dataset
+   are left as NULL, because they are set by R_nc_inq_var_cache.
+ */
+static SEXP
+R_nc_inq_var_meta (int ncid, int varid, int withnc4)
+{
+  int idim, ndims, natts, *dimids, storeprop;
+  int shuffle, deflate, deflate_level, fletcher;
+  int status;
+  size_t *chunksize_t;
+  double *chunkdbl;
+  char varname[NC_MAX_NAME + 1], vartype[NC_MAX_NAME+1];
+  nc_type xtype;
+  SEXP result, rdimids, rchunks;
+
+#ifdef HAVE_NC_INQ_VAR_ENDIAN
+  int endian;
+#endif
+#ifdef HAVE_NC_INQ_VAR_SZIP
+  int szip_options, szip_bits;
+#endif
+#ifdef HAVE_NC_INQ_VAR_FILTER
+  int filter_id;
+  size_t filter_nparams;
+  SEXP rfilter_params;
+#endif
+
+  /*-- Inquire the variable ---------------------------------------------------*/
+  R_nc_check (nc_inq_var (ncid, varid, varname, &xtype, &ndims, NULL, &natts));
+
+  R_nc_check (R_nc_type2str (ncid, xtype, vartype));
+
+  if (withnc4) {
+    result = PROTECT(allocVector (VECSXP, 18));
+  } else {
+    result = PROTECT(allocVector (VECSXP, 6));
+  }
+
+  SET_VECTOR_ELT (result, 0, ScalarInteger (varid));
+  SET_VECTOR_ELT (result, 1, mkString (varname));
+  SET_VECTOR_ELT (result, 2, mkString (vartype));
+  SET_VECTOR_ELT (result, 3, ScalarInteger (ndims));
+  SET_VECTOR_ELT (result, 5, ScalarInteger (natts));
+
+  if (ndims > 0) {
+    rdimids = PROTECT(allocVector (INTSXP, ndims));
+    SET_VECTOR_ELT (result, 4, rdimids);
+    UNPROTECT(1);
+    dimids = INTEGER (rdimids);
+    R_nc_check (nc_inq_vardimid (ncid, varid, dimids));
+    /* Return dimension ids in reverse (Fortran) order */
+    R_nc_rev_int (dimids, ndims);
+  } else {
+    /* Return single NA for scalar dimensions */
+    SET_VECTOR_ELT (result, 4, ScalarInteger (NA_INTEGER));
+  }
+
+  if (withnc4) {
+    R_nc_check (nc_inq_var_chunking (ncid, varid, &storeprop, NULL));
+
+    if (storeprop == NC_CHUNKED) {
+      rchunks = PROTECT(allocVector (REALSXP, ndims));
+      SET_VECTOR_ELT (result, 6, rchunks);
+      UNPROTECT(1);
+      chunkdbl = REAL (rchunks);
+      chunksize_t = (size_t *) R_alloc (ndims, sizeof(size_t));
+      R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, chunksize_t));
+      /* Return chunk sizes as double precision in reverse (Fortran) order */
       R_nc_rev_size (chunksize_t, ndims);
       for (idim=0; idim<ndims; idim++) {
 	chunkdbl[idim] = chunksize_t[idim];
       }
 
-#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-      R_nc_check (nc_get_var_chunk_cache (ncid, varid, &cache_bytes,
-					  &cache_slots, &cache_preemption));
-      SET_VECTOR_ELT (result, 7, ScalarReal (cache_bytes));
-      SET_VECTOR_ELT (result, 8, ScalarReal (cache_slots));
-      SET_VECTOR_ELT (result, 9, ScalarReal (cache_preemption));
-#else
+      /* Chunk cache settings may change in data mode */
       SET_VECTOR_ELT (result, 7, R_NilValue);
       SET_VECTOR_ELT (result, 8, R_NilValue);
       SET_VECTOR_ELT (result, 9, R_NilValue);
-#endif
     } else {
       /* Chunks not defined */
       SET_VECTOR_ELT (result, 6, R_NilValue);
@@ -780,6 +1089,215 @@ R_nc_inq_var (SEXP nc, SEXP var)
 }
 
 
+/* Set the chunk cache settings of a chunked variable in a netcdf4 dataset
+   in a result from R_nc_inq_var_meta.
+ */
+static void
+R_nc_inq_var_cache (int ncid, int varid, SEXP result)
+{
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  int storeprop;
+  size_t cache_bytes, cache_slots;
+  float cache_preemption;
+
+  R_nc_check (nc_inq_var_chunking (ncid, varid, &storeprop, NULL));
+  if (storeprop == NC_CHUNKED) {
+    R_nc_check (nc_get_var_chunk_cache (ncid, varid, &cache_bytes,
+                                        &cache_slots, &cache_preemption));
+    SET_VECTOR_ELT (result, 7, ScalarReal (cache_bytes));
+    SET_VECTOR_ELT (result, 8, ScalarReal (cache_slots));
+    SET_VECTOR_ELT (result, 9, ScalarReal (cache_preemption));
+  }
+#endif
+}
+
+
+SEXP
+R_nc_inq_var (SEXP nc, SEXP var)
+{
+  int ncid, varid, format, withnc4;
+  SEXP result;
+
+  /*-- Convert arguments to netcdf ids ----------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  R_nc_check (nc_inq_format (ncid, &format));
+  withnc4 = (format == NC_FORMAT_NETCDF4);
+
+  /*-- Use cached properties (if any) -----------------------------------------*/
+  result = R_nc_cache_get (ncid, 'v', varid, 0);
+  if (!result) {
+    result = R_nc_inq_var_meta (ncid, varid, withnc4);
+    R_nc_cache_put (ncid, 'v', varid, 0, result);
+  }
+  PROTECT(result);
+
+  /*-- Add properties that are not cached -------------------------------------*/
+  if (withnc4) {
+    R_nc_inq_var_cache (ncid, varid, result);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_vars()
+\*-----------------------------------------------------------------------------*/
+
+/* R types of columns in results of R_nc_inq_vars,
+   which correspond to the elements of results from R_nc_inq_var.
+   Columns of type VECSXP contain vectors that may differ in length.
+ */
+static const SEXPTYPE R_nc_inq_vars_types[] = {
+  INTSXP, STRSXP, STRSXP, INTSXP, VECSXP, INTSXP,
+  VECSXP, REALSXP, REALSXP, REALSXP, INTSXP, LGLSXP, LGLSXP, LGLSXP,
+  INTSXP, INTSXP, INTSXP, VECSXP};
+
+SEXP
+R_nc_inq_vars (SEXP nc, SEXP vars, SEXP storage)
+{
+  int ncid, nvars, ncols, ii, jj, *varids, ndims, natts, format;
+  int dimids[NC_MAX_VAR_DIMS];
+  char varname[NC_MAX_NAME+1], vartype[NC_MAX_NAME+1];
+  nc_type xtype;
+  SEXP result, rnc, rvar, info, item, col;
+
+  /*-- Convert arguments to netcdf ids ----------------------------------------*/
+  ncid = asInteger (nc);
+
+  if (isNull (vars)) {
+    R_nc_check (nc_inq_varids (ncid, &nvars, NULL));
+    varids = (int *) R_alloc (nvars, sizeof (int));
+    R_nc_check (nc_inq_varids (ncid, NULL, varids));
+  } else {
+    nvars = xlength (vars);
+    varids = (int *) R_alloc (nvars, sizeof (int));
+    for (ii=0; ii<nvars; ii++) {
+      if (isString (vars)) {
+        rvar = PROTECT(ScalarString (STRING_ELT (vars, ii)));
+      } else if (isInteger (vars)) {
+        rvar = PROTECT(ScalarInteger (INTEGER (vars)[ii]));
+      } else if (isReal (vars)) {
+        rvar = PROTECT(ScalarReal (REAL (vars)[ii]));
+      } else {
+        error ("Variables must be specified by name or id");
+      }
+      R_nc_check (R_nc_var_id (rvar, ncid, &(varids[ii])));
+      UNPROTECT(1);
+    }
+  }
+
+  /*-- Allocate columns of the result -----------------------------------------*/
+  /* Storage properties are only available in netcdf4 format */
+  ncols = 6;
+  if (asLogical (storage) == TRUE) {
+    R_nc_check (nc_inq_format (ncid, &format));
+    if (format == NC_FORMAT_NETCDF4) {
+      ncols = 18;
+    }
+  }
+
+  result = PROTECT(allocVector (VECSXP, ncols));
+  for (jj=0; jj<ncols; jj++) {
+    SET_VECTOR_ELT (result, jj, allocVector (R_nc_inq_vars_types[jj], nvars));
+  }
+
+  /*-- Inquire about each variable --------------------------------------------*/
+  rnc = PROTECT(ScalarInteger (ncid));
+  for (ii=0; ii<nvars; ii++) {
+    if (ncols == 6) {
+      /* Basic properties are found directly, as in R_nc_inq_var */
+      R_nc_check (nc_inq_var (ncid, varids[ii], varname, &xtype, &ndims,
+                              dimids, &natts));
+      R_nc_check (R_nc_type2str (ncid, xtype, vartype));
+      INTEGER (VECTOR_ELT (result, 0))[ii] = varids[ii];
+      SET_STRING_ELT (VECTOR_ELT (result, 1), ii, mkChar (varname));
+      SET_STRING_ELT (VECTOR_ELT (result, 2), ii, mkChar (vartype));
+      INTEGER (VECTOR_ELT (result, 3))[ii] = ndims;
+      if (ndims > 0) {
+        /* Dimension ids in reverse (Fortran) order */
+        R_nc_rev_int (dimids, ndims);
+        item = PROTECT(allocVector (INTSXP, ndims));
+        memcpy (INTEGER (item), dimids, ndims * sizeof (int));
+        SET_VECTOR_ELT (VECTOR_ELT (result, 4), ii, item);
+        UNPROTECT(1);
+      } else {
+        SET_VECTOR_ELT (VECTOR_ELT (result, 4), ii,
+                        ScalarInteger (NA_INTEGER));
+      }
+      INTEGER (VECTOR_ELT (result, 5))[ii] = natts;
+      continue;
+    }
+
+    /* Transpose the list from R_nc_inq_var into columns */
+    rvar = PROTECT(ScalarInteger (varids[ii]));
+    info = PROTECT(R_nc_inq_var (rnc, rvar));
+    for (jj=0; jj<ncols; jj++) {
+      col = VECTOR_ELT (result, jj);
+      item = VECTOR_ELT (info, jj);
+      switch (R_nc_inq_vars_types[jj]) {
+      case VECSXP:
+        SET_VECTOR_ELT (col, ii, item);
+        break;
+      case STRSXP:
+        SET_STRING_ELT (col, ii, STRING_ELT (item, 0));
+        break;
+      case INTSXP:
+        INTEGER (col)[ii] = (length (item) > 0) ? asInteger (item) : NA_INTEGER;
+        break;
+      case REALSXP:
+        REAL (col)[ii] = (length (item) > 0) ? asReal (item) : NA_REAL;
+        break;
+      case LGLSXP:
+        LOGICAL (col)[ii] = (length (item) > 0) ? asLogical (item) : NA_LOGICAL;
+        break;
+      default:
+        break;
+      }
+    }
+    UNPROTECT(2);
+  }
+
+  UNPROTECT(2);
+  return result;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_inq_var_dimlen()
+\*-----------------------------------------------------------------------------*/
+
+SEXP
+R_nc_inq_var_dimlen (SEXP nc, SEXP var)
+{
+  int ncid, varid, ndims, ii;
+  size_t *dimlen;
+  SEXP result;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  /*-- Find lengths of the dimensions in C order ------------------------------*/
+  R_nc_check (nc_inq_varndims (ncid, varid, &ndims));
+  dimlen = (size_t *) R_alloc (ndims > 0 ? ndims : 1, sizeof (size_t));
+  R_nc_check (R_nc_var_dimlen (ncid, varid, ndims, dimlen));
+
+  /*-- Return lengths in R order ----------------------------------------------*/
+  result = PROTECT(allocVector (REALSXP, ndims));
+  for (ii=0; ii<ndims; ii++) {
+    REAL (result)[ii] = dimlen[ndims-1-ii];
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+
 /*-----------------------------------------------------------------------------*\
  *  R_nc_par_var()
 \*-----------------------------------------------------------------------------*/
@@ -824,12 +1342,208 @@ R_nc_par_var (SEXP nc, SEXP var, SEXP access)
  *  R_nc_put_var()
 \*-----------------------------------------------------------------------------*/
 
+/* Find the C start and count of a write to variable varid,
+   deriving missing values from the data and the variable as described
+   in the man page of var.put.nc.
+   The type class and any string length are found here, so that
+   the R wrapper does not need to inquire about the variable.
+   Results are allocated by R_alloc (or NULL for scalar variables).
+ */
+static void
+R_nc_put_region (int ncid, int varid, nc_type xtype, int ndims,
+                 SEXP data, SEXP start, SEXP count,
+                 size_t **cstart, size_t **ccount)
+{
+  int class=NC_NAT, str2char, opaque, compound, *dimids=NULL;
+  int ii, nr, ndrop, nkeep, conform;
+  size_t size=0, nfields=0, dimlen, numelem, slen;
+  double *rstart, *rcount, *ccnt;
+  R_xlen_t jj, ndata;
+  SEXP rdim;
+  char *msg, *pos;
+
+  /*-- Classify the data and the type of the variable -------------------------*/
+  if (xtype > NC_MAX_ATOMIC_TYPE) {
+    R_nc_check (nc_inq_user_type (ncid, xtype, NULL, &size, NULL,
+                                  &nfields, &class));
+  }
+  str2char = (xtype == NC_CHAR && isString (data));
+  opaque = (TYPEOF (data) == RAWSXP && class == NC_OPAQUE);
+  compound = (TYPEOF (data) == VECSXP && class == NC_COMPOUND);
+
+  if (ndims > 0) {
+    dimids = (int *) R_alloc (ndims, sizeof (int));
+    R_nc_check (nc_inq_vardimid (ncid, varid, dimids));
+  }
+
+  ndata = xlength (data);
+  rdim = getAttrib (data, R_DimSymbol);
+
+  /*-- Start defaults to the first element of each dimension ------------------*/
+  rstart = R_nc_index_r2c (start, ndims, "start");
+  for (ii=0; ii<ndims; ii++) {
+    if (ISNAN (rstart[ii])) {
+      rstart[ii] = 1;
+    }
+  }
+
+  /*-- Count defaults to the shape of the data (in R order) -------------------*/
+  if (xlength (count) == 1 && ISNAN (asReal (count))) {
+    nr = isNull (rdim) ? 1 : length (rdim);
+    rcount = (double *) R_alloc (nr + ndims + 1, sizeof (double));
+    if (!isNull (rdim)) {
+      for (ii=0; ii<nr; ii++) {
+        rcount[ii] = INTEGER (rdim)[ii];
+      }
+    } else if (ndims == 0 && ndata == 1) {
+      nr = 0;
+    } else if (compound) {
+      /* Fields of compound data may have different dimensions,
+         so use dimensions of the variable instead */
+      nr = ndims;
+      for (ii=0; ii<nr; ii++) {
+        rcount[ii] = NA_REAL;
+      }
+    } else {
+      rcount[0] = ndata;
+    }
+
+    if (str2char && ndims > 0) {
+      R_nc_check (nc_inq_dimlen (ncid, dimids[ndims-1], &dimlen));
+      memmove (rcount+1, rcount, nr * sizeof (double));
+      rcount[0] = dimlen;
+      nr++;
+    } else if (opaque && nr > 0) {
+      /* Opaque items in R have an extra leading dimension */
+      memmove (rcount, rcount+1, (nr-1) * sizeof (double));
+      nr--;
+    }
+
+    if (nr != ndims) {
+      error ("Length of count must equal number of dimensions");
+    }
+    ccnt = (double *) R_alloc (ndims > 0 ? ndims : 1, sizeof (double));
+    for (ii=0; ii<ndims; ii++) {
+      ccnt[ndims-1-ii] = rcount[ii];
+    }
+  } else {
+    ccnt = R_nc_index_r2c (count, ndims, "count");
+  }
+
+  /*-- Missing counts extend to the end of each dimension ---------------------*/
+  for (ii=0; ii<ndims; ii++) {
+    if (ISNAN (ccnt[ii])) {
+      R_nc_check (nc_inq_dimlen (ncid, dimids[ii], &dimlen));
+      ccnt[ii] = (dimlen + 1 > rstart[ii]) ? dimlen - rstart[ii] + 1 : 0;
+    }
+  }
+
+  /*-- Convert to C indices ---------------------------------------------------*/
+  *cstart = NULL;
+  *ccount = NULL;
+  if (ndims > 0) {
+    *cstart = (size_t *) R_alloc (ndims, sizeof (size_t));
+    *ccount = (size_t *) R_alloc (ndims, sizeof (size_t));
+    for (ii=0; ii<ndims; ii++) {
+      (*cstart)[ii] = rstart[ii] - 1;
+      (*ccount)[ii] = ccnt[ii];
+    }
+  }
+
+  /*-- Check that length of data is sufficient --------------------------------*/
+  if (str2char && ndims > 0) {
+    numelem = R_nc_length (ndims-1, *ccount);
+  } else if (opaque) {
+    numelem = size * R_nc_length (ndims, *ccount);
+  } else if (compound) {
+    numelem = nfields;
+  } else {
+    numelem = R_nc_length (ndims, *ccount);
+  }
+  if ((size_t) ndata < numelem) {
+    error ("Not enough data elements (found %.0f, need %.0f)",
+           (double) ndata, (double) numelem);
+  }
+
+  /*-- Warn if strings will be truncated --------------------------------------*/
+  if (str2char) {
+    slen = (ndims > 0) ? (*ccount)[ndims-1] : 1;
+    for (jj=0; jj<ndata; jj++) {
+      if (strlen (CHAR (STRING_ELT (data, jj))) > slen) {
+        warning ("Strings truncated to length %.0f", (double) slen);
+        break;
+      }
+    }
+  }
+
+  /*-- Warn if array data is not conformable with count -----------------------*/
+  if (!isNull (rdim)) {
+    /* Compare dimensions in C order, ignoring any of length 1 */
+    nr = length (rdim);
+    nkeep = 0;
+    for (ii=0; ii<ndims; ii++) {
+      if ((str2char && ii == ndims-1) || ccnt[ii] == 1) {
+        continue;
+      }
+      nkeep++;
+    }
+    if (opaque && size != 1) {
+      nkeep++;
+    }
+    ndrop = 0;
+    for (ii=0; ii<nr; ii++) {
+      ndrop += (INTEGER (rdim)[ii] != 1);
+    }
+
+    if (nkeep == ndrop) {
+      /* Walk both shapes in R order */
+      jj = 0;
+      if (opaque && size != 1) {
+        while (INTEGER (rdim)[jj] == 1) {
+          jj++;
+        }
+        conform = ((size_t) INTEGER (rdim)[jj++] == size);
+      } else {
+        conform = 1;
+      }
+      for (ii=ndims-1; ii>=0 && conform; ii--) {
+        if ((str2char && ii == ndims-1) || ccnt[ii] == 1) {
+          continue;
+        }
+        while (INTEGER (rdim)[jj] == 1) {
+          jj++;
+        }
+        conform = (INTEGER (rdim)[jj++] == ccnt[ii]);
+      }
+    } else {
+      conform = 0;
+    }
+
+    if (!conform) {
+      msg = R_alloc (32 * (nr + ndims) + 64, sizeof (char));
+      pos = msg;
+      pos += sprintf (pos, "Data coerced from dimensions (");
+      for (ii=0; ii<nr; ii++) {
+        pos += sprintf (pos, (ii > 0) ? ",%i" : "%i", INTEGER (rdim)[ii]);
+      }
+      pos += sprintf (pos, ") to dimensions (");
+      for (ii=ndims-1; ii>=0; ii--) {
+        pos += sprintf (pos, (ii < ndims-1) ? ",%.0f" : "%.0f", ccnt[ii]);
+      }
+      sprintf (pos, ")");
+      warning ("%s", msg);
+    }
+  }
+}
+
+
 SEXP
 R_nc_put_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP data,
               SEXP namode, SEXP pack,
               SEXP cache_bytes, SEXP cache_slots, SEXP cache_preemption)
 {
-  int ncid, varid, ndims, ii, inamode, ispack;
+  int ncid, varid, ndims, inamode, ispack;
+  int status=NC_NOERR;
   size_t *cstart=NULL, *ccount=NULL;
   nc_type xtype;
   const void *buf;
@@ -838,10 +1552,9 @@ R_nc_put_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP data,
   size_t fillsize;
 
 #ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-  int storeprop;
-  size_t bytes, slots;
-  float preemption;
-  double bytes_in, slots_in, preempt_in;
+  R_nc_chunk_plan plan;
+  R_nc_chunk_cache cache;
+  int ischunked, cachestat;
 #endif
 
   /*-- Convert arguments to netcdf ids ----------------------------------------*/
@@ -852,42 +1565,18 @@ R_nc_put_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP data,
   inamode = asInteger (namode);
   ispack = (asLogical (pack) == TRUE);
 
-  /*-- Chunk cache options for netcdf4 files ----------------------------------*/
-#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
-  R_nc_check (nc_inq_var_chunking (ncid, varid, &storeprop, NULL));
-  if (storeprop == NC_CHUNKED) {
-    R_nc_check (nc_get_var_chunk_cache(ncid, varid,
-                                       &bytes, &slots, &preemption));
-    bytes_in = asReal (cache_bytes);
-    slots_in = asReal (cache_slots);
-    preempt_in = asReal (cache_preemption);
-    if (R_FINITE(bytes_in) || R_FINITE(slots_in) || R_FINITE(preempt_in)) {
-      if (R_FINITE(bytes_in)) {
-	bytes = bytes_in;
-      }
-      if (R_FINITE(slots_in)) {
-	slots = slots_in;
-      }
-      if (R_FINITE(preempt_in)) {
-	preemption = preempt_in;
-      }
-      R_nc_check (nc_set_var_chunk_cache(ncid, varid,
-                                         bytes, slots, preemption));
-    }
-  }
-#endif
-
   /*-- Get type and rank of the variable --------------------------------------*/
   R_nc_check (nc_inq_var (ncid, varid, NULL, &xtype, &ndims, NULL, NULL));
 
-  /*-- Convert start and count from R to C indices ----------------------------*/
-  if (ndims > 0) {
-    cstart = R_nc_dim_r2c_size (start, ndims, 0);
-    ccount = R_nc_dim_r2c_size (count, ndims, 0);
-    for (ii=0; ii<ndims; ii++) {
-      cstart[ii] -= 1;
-    }
-  }
+  /*-- Find start and count in C order from arguments and data ----------------*/
+  R_nc_put_region (ncid, varid, xtype, ndims, data, start, count,
+                   &cstart, &ccount);
+
+  /*-- Find chunks touched by the write ---------------------------------------*/
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  ischunked = R_nc_plan_chunks (ncid, varid, xtype, ndims,
+                                cstart, ccount, &plan);
+#endif
 
   /*-- Get fill attributes (if any) -------------------------------------------*/
   fillsize = R_nc_miss_att (ncid, varid, inamode, &fillp, &minp, &maxp);
@@ -903,16 +1592,382 @@ R_nc_put_var (SEXP nc, SEXP var, SEXP start, SEXP count, SEXP data,
   R_nc_check (R_nc_enddef (ncid));
 
   /*-- Write variable to file -------------------------------------------------*/
+  buf = NULL;
   if (R_nc_length (ndims, ccount) > 0) {
     buf = R_nc_r2c (data, ncid, xtype, ndims, ccount,
                     fillsize, fillp, scalep, addp);
-    R_nc_check (nc_put_vara (ncid, varid, cstart, ccount, buf));
+  }
+
+  /*-- Chunk cache options for netcdf4 files ----------------------------------*/
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  if (ischunked) {
+    R_nc_cache_set (ncid, varid, plan.ntotal, plan.chunkbytes, cache_bytes,
+                    cache_slots, cache_preemption, 0, &cache);
+  }
+#endif
+
+  if (buf) {
+    R_nc_coord_forget (ncid, varid);
+    status = nc_put_vara (ncid, varid, cstart, ccount, buf);
+  }
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  /* Restore cache settings before reporting any write error */
+  if (ischunked) {
+    cachestat = R_nc_cache_restore (&cache);
+    if (status == NC_NOERR) {
+      status = cachestat;
+    }
+  }
+#endif
+  R_nc_check (status);
+
+  return R_NilValue;
+}
+
+
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_put_vars()
+\*-----------------------------------------------------------------------------*/
+
+/* Details of one write in a batch of variables.
+   Members start and count are in C order.
+ */
+typedef struct {
+  int varid, ndims, isrec, pos;
+  size_t *start, *count;
+  const void *buf;
+} R_nc_put_item;
+
+
+/* Compare writes by their position in a classic format dataset,
+   where fixed-size variables precede record variables,
+   record variables are interleaved by record,
+   and variables are stored in order of definition.
+   Writes at the same position keep the order given by the caller,
+   so that the last write of overlapping regions takes effect.
+ */
+static int
+R_nc_put_cmp (const void *a, const void *b)
+{
+  const R_nc_put_item *pa=a, *pb=b;
+
+  if (pa->isrec != pb->isrec) {
+    return pa->isrec - pb->isrec;
+  }
+  if (pa->isrec && pa->start[0] != pb->start[0]) {
+    return (pa->start[0] < pb->start[0]) ? -1 : 1;
+  }
+  if (pa->varid != pb->varid) {
+    return pa->varid - pb->varid;
+  }
+  return pa->pos - pb->pos;
+}
+
+
+SEXP
+R_nc_put_vars (SEXP nc, SEXP vars, SEXP start, SEXP count, SEXP data,
+               SEXP namode, SEXP pack)
+{
+  int ncid, nvars, ndims, ii, jj, inamode, ispack, nunlim, *unlimids, *dimids;
+  nc_type xtype;
+  R_nc_put_item *items, *item;
+  double scale, add, *scalep, *addp;
+  void *fillp, *minp, *maxp;
+  size_t fillsize;
+
+  /*-- Convert arguments ------------------------------------------------------*/
+  ncid = asInteger (nc);
+
+  nvars = xlength (vars);
+  if (xlength (start) != nvars || xlength (count) != nvars ||
+      xlength (data) != nvars) {
+    error ("Lists of variables, start, count and data must have equal length");
+  }
+
+  inamode = asInteger (namode);
+  ispack = (asLogical (pack) == TRUE);
+
+  R_nc_check (R_nc_unlimdims (ncid, &nunlim, &unlimids));
+
+  /*-- Convert all data before writing any variable ---------------------------*/
+  items = (R_nc_put_item *) R_alloc (nvars, sizeof (R_nc_put_item));
+  for (ii=0; ii<nvars; ii++) {
+    item = &(items[ii]);
+    item->pos = ii;
+
+    R_nc_check (R_nc_var_id (VECTOR_ELT (vars, ii), ncid, &(item->varid)));
+    R_nc_check (nc_inq_var (ncid, item->varid, NULL, &xtype, &ndims,
+                            NULL, NULL));
+    item->ndims = ndims;
+    item->isrec = 0;
+
+    if (ndims > 0) {
+      dimids = (int *) R_alloc (ndims, sizeof (int));
+      R_nc_check (nc_inq_vardimid (ncid, item->varid, dimids));
+      for (jj=0; jj<nunlim; jj++) {
+        if (unlimids[jj] == dimids[0]) {
+          item->isrec = 1;
+        }
+      }
+    }
+
+    R_nc_put_region (ncid, item->varid, xtype, ndims, VECTOR_ELT (data, ii),
+                     VECTOR_ELT (start, ii), VECTOR_ELT (count, ii),
+                     &(item->start), &(item->count));
+
+    fillsize = R_nc_miss_att (ncid, item->varid, inamode, &fillp, &minp, &maxp);
+
+    scalep = NULL;
+    addp = NULL;
+    if (ispack) {
+      scalep = &scale;
+      addp = &add;
+      R_nc_pack_att (ncid, item->varid, &scalep, &addp);
+    }
+
+    item->buf = NULL;
+    if (R_nc_length (ndims, item->count) > 0) {
+      item->buf = R_nc_r2c (VECTOR_ELT (data, ii), ncid, xtype, ndims,
+                            item->count, fillsize, fillp, scalep, addp);
+    }
+  }
+
+  /*-- Enter data mode once for all variables ---------------------------------*/
+  R_nc_check (R_nc_enddef (ncid));
+
+  /*-- Write variables in order of their position in the file -----------------*/
+  qsort (items, nvars, sizeof (R_nc_put_item), R_nc_put_cmp);
+
+  for (ii=0; ii<nvars; ii++) {
+    item = &(items[ii]);
+    if (item->buf) {
+      R_nc_coord_forget (ncid, item->varid);
+      R_nc_check (nc_put_vara (ncid, item->varid, item->start, item->count,
+                               item->buf));
+    }
   }
 
   return R_NilValue;
 }
 
 
+/*-----------------------------------------------------------------------------*\
+ *  R_nc_scatter_var()
+\*-----------------------------------------------------------------------------*/
+
+/* A point of a scatter write, with its C index (ndims elements),
+   the chunk sizes of the variable and its position in the input.
+ */
+typedef struct {
+  int ndims;
+  const size_t *index, *chunk;
+  size_t pos;
+} R_nc_scatter_point;
+
+
+/* Compare points by chunk, then by C index within each chunk,
+   then by position in the input (so later values of repeated points win).
+ */
+static int
+R_nc_scatter_cmp (const void *a, const void *b)
+{
+  const R_nc_scatter_point *pa=a, *pb=b;
+  size_t ca, cb;
+  int idim;
+
+  for (idim=0; idim<pa->ndims; idim++) {
+    ca = pa->index[idim] / pa->chunk[idim];
+    cb = pb->index[idim] / pb->chunk[idim];
+    if (ca != cb) {
+      return (ca < cb) ? -1 : 1;
+    }
+  }
+  for (idim=0; idim<pa->ndims; idim++) {
+    if (pa->index[idim] != pb->index[idim]) {
+      return (pa->index[idim] < pb->index[idim]) ? -1 : 1;
+    }
+  }
+  return (pa->pos < pb->pos) ? -1 : (pa->pos > pb->pos);
+}
+
+
+SEXP
+R_nc_scatter_var (SEXP nc, SEXP var, SEXP index, SEXP data,
+                  SEXP namode, SEXP pack)
+{
+  int ncid, varid, ndims, idim, jdim, ispack, nunlim, *unlimids, *dimids;
+  int ii, isunlim, storeprop, status=NC_NOERR;
+  size_t npts, kk, run, nrun, elsize, *cindex, *dimlen, *chunk;
+  size_t *rstart, *rcount;
+  R_nc_scatter_point *points;
+  const size_t *pp, *pq;
+  const double *rindex;
+  double rval, scale, add, *scalep=NULL, *addp=NULL;
+  void *fillp=NULL, *minp=NULL, *maxp=NULL;
+  size_t fillsize;
+  nc_type xtype;
+  const char *buf;
+  char *sorted;
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  R_nc_chunk_cache cache;
+  int cachestat;
+#endif
+
+  /*-- Convert arguments to netcdf ids ----------------------------------------*/
+  ncid = asInteger (nc);
+
+  R_nc_check (R_nc_var_id (var, ncid, &varid));
+
+  ispack = (asLogical (pack) == TRUE);
+
+  R_nc_check (nc_inq_var (ncid, varid, NULL, &xtype, &ndims, NULL, NULL));
+  if (ndims < 1) {
+    error ("Cannot scatter values to a scalar variable");
+  }
+  if (xtype == NC_CHAR || xtype > NC_MAX_ATOMIC_TYPE) {
+    error ("Scatter writes do not support the type of this variable");
+  }
+  R_nc_check (nc_inq_type (ncid, xtype, NULL, &elsize));
+
+  /*-- Find dimension lengths and chunk sizes ---------------------------------*/
+  dimids = (int *) R_alloc (ndims, sizeof (int));
+  dimlen = (size_t *) R_alloc (ndims, sizeof (size_t));
+  chunk = (size_t *) R_alloc (ndims, sizeof (size_t));
+  R_nc_check (nc_inq_vardimid (ncid, varid, dimids));
+  R_nc_check (R_nc_unlimdims (ncid, &nunlim, &unlimids));
+  for (idim=0; idim<ndims; idim++) {
+    R_nc_check (nc_inq_dimlen (ncid, dimids[idim], &(dimlen[idim])));
+    isunlim = 0;
+    for (ii=0; ii<nunlim; ii++) {
+      isunlim = isunlim || (unlimids[ii] == dimids[idim]);
+    }
+    if (isunlim) {
+      /* Points may be written beyond the current length */
+      dimlen[idim] = SIZE_MAX;
+    }
+  }
+
+  storeprop = NC_CONTIGUOUS;
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  if (nc_inq_var_chunking (ncid, varid, &storeprop, NULL) == NC_NOERR &&
+      storeprop == NC_CHUNKED) {
+    R_nc_check (nc_inq_var_chunking (ncid, varid, NULL, chunk));
+  }
+#endif
+  if (storeprop != NC_CHUNKED) {
+    /* Sort points of a contiguous variable by their offset */
+    for (idim=0; idim<ndims; idim++) {
+      chunk[idim] = SIZE_MAX;
+    }
+  }
+
+  /*-- Convert R indices to C order and check their range ---------------------*/
+  if (!isReal (index) || (xlength (index) % ndims) != 0) {
+    error ("Index must be a numeric matrix with a column for each dimension");
+  }
+  npts = xlength (index) / ndims;
+  rindex = REAL (index);
+  cindex = (size_t *) R_alloc (npts * ndims, sizeof (size_t));
+  for (kk=0; kk<npts; kk++) {
+    for (idim=0; idim<ndims; idim++) {
+      rval = rindex[kk + (ndims - 1 - idim) * npts];
+      if (!R_FINITE (rval) || rval < 1 || rval > dimlen[idim]) {
+        error ("Index outside range of dimension");
+      }
+      if (rval != floor (rval)) {
+        error ("Index must contain whole numbers");
+      }
+      cindex[kk * ndims + idim] = rval - 1;
+    }
+  }
+
+  if (npts == 0) {
+    return ScalarReal (0);
+  }
+
+  /*-- Convert data to the external type --------------------------------------*/
+  fillsize = R_nc_miss_att (ncid, varid, asInteger (namode),
+                            &fillp, &minp, &maxp);
+  if (ispack) {
+    scalep = &scale;
+    addp = &add;
+    R_nc_pack_att (ncid, varid, &scalep, &addp);
+  }
+  buf = R_nc_r2c (data, ncid, xtype, 1, &npts, fillsize, fillp, scalep, addp);
+
+  /*-- Sort points by chunk and gather their values ---------------------------*/
+  points = (R_nc_scatter_point *) R_alloc (npts, sizeof (R_nc_scatter_point));
+  for (kk=0; kk<npts; kk++) {
+    points[kk].ndims = ndims;
+    points[kk].index = cindex + kk * ndims;
+    points[kk].chunk = chunk;
+    points[kk].pos = kk;
+  }
+  qsort (points, npts, sizeof (R_nc_scatter_point), R_nc_scatter_cmp);
+
+  sorted = R_alloc (npts, elsize);
+  for (kk=0; kk<npts; kk++) {
+    memcpy (sorted + kk * elsize, buf + points[kk].pos * elsize, elsize);
+  }
+
+  /*-- Enter data mode (if necessary) -----------------------------------------*/
+  R_nc_check (R_nc_enddef (ncid));
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  /* Hold at least one chunk in the cache, so that the runs of each chunk
+     are combined before the chunk is compressed and written */
+  if (storeprop == NC_CHUNKED) {
+    R_nc_cache_fit (ncid, varid, 1, R_nc_length (ndims, chunk) * elsize,
+                    NA_REAL, NA_REAL, &cache);
+  }
+#endif
+
+  /*-- Write runs of consecutive points along the fastest dimension -----------*/
+  rstart = (size_t *) R_alloc (ndims, sizeof (size_t));
+  rcount = (size_t *) R_alloc (ndims, sizeof (size_t));
+  R_nc_coord_forget (ncid, varid);
+  nrun = 0;
+  for (kk=0; kk<npts && status == NC_NOERR; kk+=run) {
+    pp = points[kk].index;
+    for (run=1; kk+run<npts; run++) {
+      pq = points[kk+run].index;
+      if (pq[ndims-1] != pp[ndims-1] + run ||
+          pq[ndims-1] / chunk[ndims-1] != pp[ndims-1] / chunk[ndims-1]) {
+        break;
+      }
+      for (jdim=0; jdim<ndims-1 && pq[jdim] == pp[jdim]; jdim++);
+      if (jdim < ndims-1) {
+        break;
+      }
+    }
+
+    for (idim=0; idim<ndims; idim++) {
+      rstart[idim] = pp[idim];
+      rcount[idim] = 1;
+    }
+    rcount[ndims-1] = run;
+    status = nc_put_vara (ncid, varid, rstart, rcount, sorted + kk * elsize);
+    nrun++;
+  }
+
+#ifdef HAVE_NC_GET_VAR_CHUNK_CACHE
+  /* Restore cache settings before reporting any write error */
+  if (storeprop == NC_CHUNKED) {
+    cachestat = R_nc_cache_restore (&cache);
+    if (status == NC_NOERR) {
+      status = cachestat;
+    }
+  }
+#endif
+  R_nc_check (status);
+
+  /* Return the number of hyperslabs written */
+  return ScalarReal (nrun);
+}
+
+
 /*-----------------------------------------------------------------------------*\
  *  R_nc_rename_var()
 \*-----------------------------------------------------------------------------*/